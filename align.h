@@ -0,0 +1,140 @@
+/* balance -- LV2 stereo balance control
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Inter-channel time alignment, not for realtime use. */
+
+#ifndef BLC_ALIGN_H
+#define BLC_ALIGN_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "fft.h"
+
+/* Delay estimate by generalized cross-correlation with phase transform
+ * (GCC-PHAT). The cross-spectrum of both channels is accumulated over
+ * Hann-windowed frames with 50% overlap, whitened (only the phase is
+ * kept) and transformed back. The lag of the largest correlation
+ * magnitude is the delay, its sign the polarity.
+ *
+ * Frames are at least four times the largest lag, so that the circular
+ * correlation of a frame does not wrap into the lag range.
+ */
+
+#define ALIGN_EPS (1e-9) // bins below this fraction of the max. are ignored
+
+typedef struct {
+	int   delay;      // [samples] > 0: the right channel lags the left
+	float polarity;   // -1: inverted
+	float confidence; // 0..1, correlation peak of the whitened spectra
+} AlignResult;
+
+/* analyze `n` samples of both channels for lags up to +-`maxlag`.
+ * Returns -1 if out of memory, or if either channel is silent. */
+static int
+align_analyze(const float* l, const float* r, const uint32_t n, const uint32_t maxlag, AlignResult* res)
+{
+	uint32_t len = 2;
+	while (len < 4 * maxlag) {
+		len <<= 1;
+	}
+	if (n < len) {
+		return -1;
+	}
+
+	double* const mem = (double*) malloc(7 * len * sizeof(double));
+	if (!mem) {
+		return -1;
+	}
+	double* const re  = mem;
+	double* const im  = &mem[len];
+	double* const gr  = &mem[2 * len]; // cross-spectrum
+	double* const gi  = &mem[3 * len];
+	double* const wr  = &mem[4 * len];
+	double* const wi  = &mem[5 * len];
+	double* const win = &mem[6 * len];
+
+	fft_init(wr, wi, win, len);
+	memset(gr, 0, 2 * len * sizeof(double));
+
+	double el = 0, er = 0;
+	for (uint32_t pos = 0; pos + len <= n; pos += len / 2) {
+		/* both (real) channels in one transform: left + i right */
+		for (uint32_t k = 0; k < len; ++k) {
+			re[k] = l[pos + k] * win[k];
+			im[k] = r[pos + k] * win[k];
+			el += re[k] * re[k];
+			er += im[k] * im[k];
+		}
+		fft_run(re, im, wr, wi, len);
+
+		for (uint32_t k = 0; k < len; ++k) {
+			/* G += L R* */
+			double lr, li, rr, ri;
+			fft_split(re, im, k, len, &lr, &li, &rr, &ri);
+			gr[k] += lr * rr + li * ri;
+			gi[k] += li * rr - lr * ri;
+		}
+	}
+
+	if (el < 1e-12 || er < 1e-12) {
+		free(mem);
+		return -1;
+	}
+
+	/* phase transform */
+	double gmax = 0;
+	for (uint32_t k = 0; k < len; ++k) {
+		gmax = fmax(gmax, gr[k] * gr[k] + gi[k] * gi[k]);
+	}
+	uint32_t bins = 0;
+	for (uint32_t k = 0; k < len; ++k) {
+		const double g = gr[k] * gr[k] + gi[k] * gi[k];
+		if (g > ALIGN_EPS * ALIGN_EPS * gmax) {
+			const double a = 1.0 / sqrt(g);
+			/* conjugate: inverse transform by the forward one */
+			re[k] = gr[k] * a;
+			im[k] = -gi[k] * a;
+			++bins;
+		} else {
+			re[k] = im[k] = 0;
+		}
+	}
+	fft_run(re, im, wr, wi, len);
+
+	/* re[t] = sum l[i + t] r[i], a lag of the right channel peaks at -t */
+	int    best = 0;
+	double peak = 0;
+	for (int t = -(int)maxlag; t <= (int)maxlag; ++t) {
+		const double c = re[t & (len - 1)];
+		if (fabs(c) > fabs(peak)) {
+			peak = c;
+			best = t;
+		}
+	}
+
+	res->delay      = -best;
+	res->polarity   = peak < 0 ? -1.f : 1.f;
+	res->confidence = bins > 0 ? fmin(1.0, fabs(peak) / bins) : 0;
+	free(mem);
+	return 0;
+}
+
+#endif
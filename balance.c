@@ -21,31 +21,63 @@
 #include <string.h>
 #include <math.h>
 #include <assert.h>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 #ifdef HAVE_LV2_1_18_6
 #include <lv2/core/lv2.h>
 #include <lv2/state/state.h>
+#include <lv2/worker/worker.h>
 #else
 #include <lv2/lv2plug.in/ns/lv2core/lv2.h>
 #include <lv2/lv2plug.in/ns/ext/state/state.h>
+#include <lv2/lv2plug.in/ns/ext/worker/worker.h>
 #endif
 
 #include "uris.h"
+#include "kernels.h"
+#include "meters.h"
+#include "align.h"
+#include "bands.h"
 
-#define MAXDELAY (2001)
+#define MAXDELAY_MS (50.0) // milliseconds -- range of the [ms] delay ports
+#define MAXDELAY_SPL (2000) // samples -- range of the [samples] delay ports
 #define CHANNELS (2)
+#define CHANNELS_CHUNK (256) // samples -- N-channel conditioners, see process_channels()
+#define DLY_ALIGN (64) // bytes -- cache line
 
 #define C_LEFT (0)
 #define C_RIGHT (1)
 
-#define FADE_LEN (64)
+#define FADE_LEN (64)       // samples -- gain and channel-map changes
+#define DLY_FADE_MS (20.0)  // milliseconds -- delay changes
 #define METER_FALLOFF (13.3) // dB/sec
-#define UPDATE_FREQ (30.0)   // Hz
+#define UPDATE_FREQ (30.0)   // Hz -- default meter update rate
+#define UPDATE_FREQ_MIN (10.0)
+#define UPDATE_FREQ_MAX (120.0)
 #define PEAK_HOLD_TIME (2.0) // seconds
 
+#define MTR_UPDATES (64)    // max. meter updates per cycle, later ones are merged
+
 #define PEAK_INTEGRATION_MAX (0.05)   // seconds -- used for buffer size limit
 #define PEAK_INTEGRATION_TIME (0.005) // seconds -- must be >=0; should be <= PEAK_INTEGRATION_MAX
-#define PHASE_INTEGRATION_TIME (.5)   // seconds -- must be > 0
+#define PHASE_INTEGRATION_TIME (.5)   // seconds -- default
+#define PHASE_INTEGRATION_MIN (.05)   // seconds -- range of CFG_PHASE_WINDOW
+#define PHASE_INTEGRATION_MAX (5.0)
+
+#define MW_CHUNK (1024)     // samples -- max frames per audio record
+#define MW_RING_TIME (.5)   // seconds -- audio queued for the metering worker
+#define MW_CFG_KEYS (16)    // meter cfg keys forwarded to the worker
+#define MW_CMD_MAX (MW_CFG_KEYS + 4) // pending commands, one per kind, see mw_cmd_queue()
+#define MW_CMD_RESERVE (6 * MW_CMD_MAX) // ring space [floats] audio records leave for commands
+
+#define ALIGN_TIME (3.0)           // seconds -- input captured for the alignment analysis
+#define ALIGN_MIN_CONFIDENCE (.1)  // below: no estimate
+
+#define SCOPE_CHUNK (256)   // samples -- vectorscope decimation pass
+
+#define MTR_NOALLOC (MTR_PHASE | MTR_TRUEPEAK_IN | MTR_TRUEPEAK_OUT) // meters without heap memory
 
 #define SIGNUM(a)  ( (a) < 0 ? -1 : 1)
 #define SQUARE(a)  ( (a) * (a) )
@@ -70,64 +102,233 @@ typedef enum {
 	BLC_OUTL,
 	BLC_OUTR,
 	BLC_UICONTROL,
-	BLC_UINOTIFY
+	BLC_UINOTIFY,
+	BLC_DLYLMS,
+	BLC_DLYRMS
 } PortIndex;
 
+/* gain smoother: linear ramp from `amp` to `target` over `len`
+ * samples, constant afterwards. `off` is the number of ramp samples
+ * already processed in previous cycles. */
+typedef struct {
+	float    amp;
+	float    step;
+	float    target;
+	uint32_t len;
+	uint32_t off;
+} GainRamp;
+
+/* cross-fade between two settings, may span many cycles */
+typedef struct {
+	uint32_t pos;
+	uint32_t len; // 0: inactive
+} XFade;
+
+/* delay ring and gain smoother of one channel */
+typedef struct {
+	float* buffer; // see DelayCore
+
+	/* buffer offsets */
+	int w_ptr;
+	int r_ptr;
+
+	/* current settings (targets of the smoothers) */
+	GainRamp c_gain;
+	int      c_dly;
+
+	/* delay change: read-pointer of the previous delay */
+	XFade x_dly;
+	int   x_rptr;
+} Strip;
+
+/* delay rings -- power of two, allocated at instantiate.
+ * The size is at least twice the max delay, the headroom
+ * beyond the max delay is the largest block copied at once. */
+typedef struct {
+	GainKernels gk; // for the CPU at hand
+	float samplerate;
+	int   dlymask;  // ring size - 1
+	int   maxdelay; // [samples] exclusive
+	int   dly_fade_len; // [samples] delay change cross-fade
+} DelayCore;
+
+/* metering worker: jobs, records in the analysis ring */
+enum {
+	MW_OFF = 0,
+	MW_STARTING, // ring allocation scheduled
+	MW_ON,       // the worker owns the meters
+	MW_STOPPING, // worker drains the ring, then hands the meters back
+};
+
+enum {
+	MW_JOB_ALLOC = 0,
+	MW_JOB_RUN,
+	MW_JOB_FREE,
+	MW_JOB_METERS, // allocate meter memory
+	AL_JOB_ALLOC,  // alignment analysis, not counted in mw_pending
+	AL_JOB_RUN,
+	BD_JOB_ALLOC,  // multiband phase correlation, not counted in mw_pending
+	BD_JOB_RUN,
+};
+
+/* alignment analysis, started by cfg key 10 */
+enum {
+	AL_IDLE = 0,
+	AL_ALLOC,   // capture buffer allocation scheduled
+	AL_CAPTURE, // the audio thread copies the input
+	AL_ANALYZE, // the worker estimates delay and polarity
+};
+
+enum {
+	MW_REC_AUDIO = 0, // [n] in L, in R, out L, out R
+	MW_REC_SILENCE,   // [n_samples]
+	MW_REC_CFG,       // [key] value
+	MW_REC_STATE,     // [0] state[0..3]
+	MW_REC_RESET,     // [0]
+	MW_REC_MASK,      // [meters]
+};
+
+/* values for the UI, collected during a cycle or by the worker */
+typedef struct {
+	uint32_t mask; // bit per key
+	float    val[MTR_FRAME_KEYS];
+} MeterMsgs;
+
+typedef struct {
+	AnalysisRing ring;
+	float*       scratch; // one audio record
+	MeterMsgs    out;     // result of MW_JOB_RUN
+} MeterWorkerBuf;
+
+/* meter command waiting for ring space */
+typedef struct {
+	int      type; // MW_REC_*
+	uint32_t arg;
+	uint32_t len;
+	float    data[4];
+} MeterCmd;
+
+/* input captured for the alignment analysis */
 typedef struct {
-  LV2_URID_Map* map;
-  balanceURIs uris;
+	float*   buf[CHANNELS];
+	uint32_t len; // [samples]
+} AlignCapture;
 
-  LV2_Atom_Forge forge;
-  LV2_Atom_Forge_Frame frame;
-  const LV2_Atom_Sequence* control;
-  LV2_Atom_Sequence* notify;
+/* input peaks up to a meter update, see rt_meter_input(),
+ * and output levels, see rt_level_output() */
+typedef struct {
+	float  peak[CHANNELS];
+	double peakM[CHANNELS];
+	float  tp[CHANNELS];
+	double energy[CHANNELS];
+	float  peak_out[CHANNELS];
+	double peakM_out[CHANNELS];
+} MeterLatch;
+
+/* meter memory allocated by MW_JOB_METERS */
+typedef struct {
+	uint32_t      meters; // allocated
+	uint32_t      failed;
+	RMSIntegrator rms_in[CHANNELS], rms_out[CHANNELS];
+	Loudness*     lufs;
+} MeterAlloc;
 
+typedef struct {
+	int             type;
+	MeterWorkerBuf* buf;
+	uint32_t        meters; // MW_JOB_METERS: to allocate
+	AlignCapture*   al;
+	BandAnalysis*   bd;
+	uint32_t        bpo;    // BD_JOB_RUN: bands per octave
+} MeterJob;
+
+/* kept small for the host's response buffer: larger results are
+ * left in memory that the audio thread reads once it has the response
+ * (MeterWorkerBuf.out, mw_alloc, bd_wval), one job of each kind runs
+ * at a time */
+typedef struct {
+	int             type;
+	MeterWorkerBuf* buf;    // MW_JOB_ALLOC, MW_JOB_RUN
+	AlignCapture*   al;     // AL_JOB_ALLOC
+	AlignResult     al_res;
+	int             al_err;
+	BandAnalysis*   bd;     // BD_JOB_ALLOC
+	uint32_t        bd_n;   // BD_JOB_RUN: bands in bd_wval
+} MeterJobResponse;
+
+/* hot state (used by every run()) first, metering state last */
+typedef struct {
 	/* control ports */
 	float* trim;
 	float* phase[CHANNELS];
 	float* balance;
 	float* unitygain;
 	float* monomode;
-	float* delay[CHANNELS];
+	float* delay[CHANNELS];    // [samples]
+	float* delay_ms[CHANNELS]; // [ms]
 	float* input[CHANNELS];
 	float* output[CHANNELS];
+	const LV2_Atom_Sequence* control;
+	LV2_Atom_Sequence* notify;
 
-	/* delay buffers */
-	float buffer[CHANNELS][MAXDELAY];
+	/* delay rings, gain smoothers */
+	DelayCore dly;
+	Strip     strip[CHANNELS];
+	int       c_monomode;
 
-	/* buffer offsets */
-	int w_ptr[CHANNELS];
-	int r_ptr[CHANNELS];
+	/* meter kernels for the CPU at hand */
+	MeterKernels mk;
 
-	/* current settings */
-	float c_amp[CHANNELS];
-	int   c_dly[CHANNELS];
-	int   c_monomode;
+	/* channel-map change: previous mode */
+	XFade x_mono;
+	int   x_monomode;
 
 	float samplerate;
+	int uicom_active;
+
+	uint32_t silence; // [samples] trailing digital silence of both inputs
+
+	LV2_URID_Map* map;
+	balanceURIs uris;
+
+	LV2_Atom_Forge forge;
+	LV2_Atom_Forge_Frame frame;
+
 	float p_bal[CHANNELS];
 	int   p_dly[CHANNELS];
 
-	int uicom_active;
-
-	float meter_falloff;
-	float peak_hold;
+	float meter_falloff;      // [dB] per update
+	float peak_hold;          // [updates]
+	float meter_falloff_pref; // [dB/s]
+	float peak_hold_pref;     // [s]
+	float update_rate;        // [Hz] cfg key 9
+	uint32_t update_period;   // [samples] also read by the audio thread
 
 	/* peak hold */
-	int     p_peakcnt;
-	int     peak_integrate_pos, peak_integrate_pref, peak_integrate_max;
+	uint32_t p_peakcnt;       // [samples] since the last update
+	MeterLatch latch[MTR_UPDATES + 1];
+	int     peak_integrate_pref, peak_integrate_max;
 	float   p_peak_in[CHANNELS],    p_peak_out[CHANNELS];   // [abs max signal] peak hold
-	double *p_peak_inPi[CHANNELS], *p_peak_outPi[CHANNELS]; // [sqaread signal] integration data buffer
-	double  p_peak_inP[CHANNELS],   p_peak_outP[CHANNELS];  // [squared signal] current
+	RMSIntegrator rms_in[CHANNELS], rms_out[CHANNELS];      // [squared signal] integration
 	double  p_peak_inM[CHANNELS],   p_peak_outM[CHANNELS];  // [squared signal] max
+	double  p_energy_in[CHANNELS];  // [squared signal] sum since the last update
+
+	/* long-term input L/R ratio, cfg key 11 resets */
+	BalanceStat bal;
 
 	/* visible peak w/ falloff */
 	float p_vpeak_in[CHANNELS];  // [dBFS]
 	float p_vpeak_out[CHANNELS]; // [dbFS]
 
-	int     phase_integrate_pos, phase_integrate_max;
-	double *p_phase_outPi, *p_phase_outNi;
-	double  p_phase_outP,   p_phase_outN;
+	PhaseCorrelator pc;   // output phase correlation
+	int     phase_integrate_pref;
+
+	/* meters requested by the UI. The memory of a meter is allocated
+	 * when it is first requested, by the worker if there is one */
+	uint32_t meters_want; // audio thread
+	uint32_t meters_req;  // meter owner: requested
+	uint32_t meters_mem;  // meter owner: allocated
+	uint32_t meters;      // meter owner: running
 
 	/* peak hold */
 	float p_tme_in[CHANNELS];  // [samples]
@@ -135,82 +336,322 @@ typedef struct {
 	float p_max_in[CHANNELS];  // [dbFS]
 	float p_max_out[CHANNELS]; // [dbFS]
 
+	/* true-peak, hold */
+	TruePeak tp_in[CHANNELS], tp_out[CHANNELS];
+	float p_peak_tp_in[CHANNELS], p_peak_tp_out[CHANNELS];
+	float p_tme_tp_in[CHANNELS],  p_tme_tp_out[CHANNELS];
+	float p_max_tp_in[CHANNELS],  p_max_tp_out[CHANNELS];  // [dBTP]
+
+	/* EBU R128 loudness of the output */
+	Loudness* lufs;
+
 	int   queue_stateswitch;
-	float state[3];
+	float state[5];
+
+	/* metering worker (opt-in). While it is active the audio thread
+	 * only queues audio and meter commands, the worker runs the meters
+	 * and responds with the messages for the UI. */
+	LV2_Worker_Schedule* schedule;
+	int        mw_want;    // requested, cfg key 5
+	int        mw_state;
+	int        mw_pending; // scheduled jobs without response
+	int        mw_ctl;     // command queued since the last job
+	MeterCmd   mw_cmd[MW_CMD_MAX]; // commands that did not fit into the ring yet
+	uint32_t   mw_ncmd;
+	int        mw_rec;     // audio of this cycle is queued
+	uint32_t   mw_queued;  // [samples] since the last job
+	MeterWorkerBuf* mw_buf;
+	MeterMsgs* mw_out;     // worker: collects meter_emit()
+	MeterAlloc mw_alloc;   // worker: result of MW_JOB_METERS
+	uint32_t   wk_lost;    // bit per job type whose response the host did not take
+
+	/* alignment analysis: the audio thread captures the input,
+	 * the worker estimates delay and polarity */
+	AlignCapture* al_cap;
+	int        al_state;
+	int        al_mode;    // 1: analyze, 2: analyze, the UI applies the delay
+	uint32_t   al_pos;     // [samples] captured
+
+	/* multiband phase correlation: the audio thread queues the output,
+	 * the worker analyzes it once per meter update */
+	BandAnalysis* bd;
+	uint32_t   bd_bpo;     // bands per octave, cfg key 12, 0: off
+	int        bd_pending; // job scheduled
+	uint32_t   bd_queued;  // [samples] since the last job
+	int        bd_new;     // result to send
+	uint32_t   bd_resbpo, bd_n;
+	int        bd_first;
+	float      bd_val[BANDS_MAX];
+	float      bd_wval[BANDS_MAX]; // worker: result of BD_JOB_RUN
+
+	/* vectorscope, cfg key 13: 1: L,R  2: M,S  0: off.
+	 * The loudest sample of every `stride` is a point. */
+	int        scope_mode;
+	uint32_t   scope_n;    // points collected
+	uint32_t   scope_acc;  // [samples] of the current point
+	uint32_t   scope_stride;
+	float      scope_pk;   // current point: L^2 + R^2
+	int        scope_ready;
+	float      scope_pts[2 * SCOPE_POINTS];
+	float      scope_out[2 * SCOPE_POINTS];
+
+	/* meter values to send at the end of the cycle */
+	MeterMsgs  msgs;
+	MeterMsgs  sent;       // last values sent, mask: valid
+	float      deadband;   // [dB] cfg key 8, smaller changes are not sent
+	uint32_t   frame_seq;
+	float      bal_ratio;  // last BALANCE_RATIO
+	int        bal_valid;
+	int        bal_mode;   // gain mode of the last BALANCE_SUGGEST
 } BalanceControl;
 
-#define DLYWITHGAIN(GAIN) \
-	buffer[ self->w_ptr[chn] ] = input[pos]; \
-	output[pos] = buffer[ self->r_ptr[chn] ] * (GAIN);
+static inline uint32_t
+xfade_remain(const XFade *x)
+{
+	return x->len - x->pos;
+}
+
+/* gain at sample `pos` of the current cycle */
+static inline float
+gain_at(const GainRamp *g, const uint32_t pos)
+{
+	const uint32_t k = g->off + pos;
+	if (k >= g->len) {
+		return g->target;
+	}
+	/* same rounding as the gain-ramp kernels */
+	float d = g->step * (float)k;
+	NO_CONTRACT(d);
+	return g->amp + d;
+}
 
-#define INCREMENT_PTRS(CHN) \
-	self->r_ptr[CHN] = (self->r_ptr[CHN] + 1) % MAXDELAY; \
-	self->w_ptr[CHN] = (self->w_ptr[CHN] + 1) % MAXDELAY;
+/* apply gain for samples [pos, pos + n) of the cycle */
+static inline void
+apply_gain(const DelayCore *d, const GainRamp *g,
+		float* const out, const float* const in,
+		const uint32_t n, const uint32_t pos)
+{
+	const uint32_t k = g->off + pos;
+	if (k >= g->len) {
+		d->gk.gain(out, in, n, g->target);
+	} else if (k + n <= g->len) {
+		d->gk.ramp(out, in, n, g->amp, g->step, k);
+	} else {
+		d->gk.ramp_const(out, in, n, g->amp, g->step, k, g->len, g->target);
+	}
+}
 
-#define SMOOTHGAIN (amp + (target_amp - amp) * (float) MIN(pos, fade_len) / (float)fade_len)
+/* copy a block of input into the delay ring
+ * (at most two contiguous spans, split at the ring wrap) */
+static inline void
+dly_write(const DelayCore *d, Strip *s,
+		const float* const input, const uint32_t n)
+{
+	float* const buffer = s->buffer;
+	const int w_ptr = s->w_ptr;
+	const uint32_t n1 = MIN(n, (uint32_t)(d->dlymask + 1 - w_ptr));
+	memcpy(&buffer[w_ptr], input, n1 * sizeof(float));
+	memcpy(buffer, &input[n1], (n - n1) * sizeof(float));
+	s->w_ptr = (w_ptr + n) & d->dlymask;
+}
 
-static void
-process_channel(BalanceControl *self,
-		const float target_amp, const uint32_t chn,
-		const uint32_t n_samples)
+/* read a block from the delay ring and apply gain */
+static inline void
+dly_read(const DelayCore *d, Strip *s,
+		float* const output, const uint32_t n, const uint32_t pos)
 {
-	uint32_t pos = 0;
-	const float  delay = *(self->delay[chn]);
-	const float* const input = self->input[chn];
-	float* const output = self->output[chn];
-	float* const buffer = self->buffer[chn];
-	const float amp = self->c_amp[chn];
+	const float* const buffer = s->buffer;
+	const int r_ptr = s->r_ptr;
+	const uint32_t n1 = MIN(n, (uint32_t)(d->dlymask + 1 - r_ptr));
+	apply_gain(d, &s->c_gain, output, &buffer[r_ptr], n1, pos);
+	apply_gain(d, &s->c_gain, &output[n1], buffer, n - n1, pos + n1);
+	s->r_ptr = (r_ptr + n) & d->dlymask;
+}
 
-	// TODO bridge cycles if smoothing is longer than n_samples
-	const uint32_t fade_len = (n_samples >= FADE_LEN) ? FADE_LEN : n_samples;
+/* zero delay: amplify [pos, n_samples) straight from input to output.
+ * The ring is kept warm with the most recent maxdelay input samples,
+ * so that a later delay change can cross-fade into valid data. */
+static inline void
+dly_bypass(const DelayCore *d, Strip *s,
+		const float* const in, float* const out,
+		const uint32_t pos, const uint32_t n_samples)
+{
+	const float* const input = &in[pos];
+	float* const output = &out[pos];
+	const uint32_t n = n_samples - pos;
+	const uint32_t keep = MIN(n, (uint32_t)d->maxdelay);
 
-	if (self->c_dly[chn] != rint(delay)) {
-		/* delay length changed */
-		const int r_ptr = self->r_ptr[chn];
-		const int w_ptr = self->w_ptr[chn];
+	s->w_ptr = (s->w_ptr + n - keep) & d->dlymask;
+	dly_write(d, s, &input[n - keep], keep);
+	s->r_ptr = s->w_ptr;
 
-		/* fade out */
-		for (; pos < fade_len; pos++) {
-			const float gain = (float)(fade_len - pos) / (float)fade_len;
-			DLYWITHGAIN(gain * SMOOTHGAIN)
-			INCREMENT_PTRS(chn);
-		}
+	apply_gain(d, &s->c_gain, output, input, n, pos);
+}
 
-		/* restore pointers to beginning of fade. */
-		self->r_ptr[chn] = r_ptr;
-		self->w_ptr[chn] = w_ptr;
-		INCREMENT_PTRS(chn);
-		pos = 1;
+/* delay and amplify [pos, n_samples) using block copies.
+ * The block is split so that the write never overtakes the
+ * read-pointer: the input is written before the output is
+ * produced, which also works for in-place processing. */
+static inline void
+dly_block(const DelayCore *d, Strip *s,
+		const float* const input, float* const output,
+		uint32_t pos, const uint32_t n_samples)
+{
+	if (s->c_dly == 0) {
+		dly_bypass(d, s, input, output, pos, n_samples);
+		return;
+	}
 
-		/* update read pointer */
-		self->r_ptr[chn] += self->c_dly[chn] - rintf(delay);
-		if (self->r_ptr[chn] < 0) {
-			self->r_ptr[chn] -= MAXDELAY * floor(self->r_ptr[chn] / (float)MAXDELAY);
-		}
-		self->r_ptr[chn] = self->r_ptr[chn] % MAXDELAY;
-		self->c_dly[chn] = rint(delay);
+	const uint32_t max_len = d->dlymask + 1 - s->c_dly;
+	while (pos < n_samples) {
+		const uint32_t len = MIN(n_samples - pos, max_len);
+		dly_write(d, s, &input[pos], len);
+		dly_read(d, s, &output[pos], len, pos);
+		pos += len;
+	}
+}
 
-		/* fade in, x-fade */
-		for (; pos < fade_len; pos++) {
-			const float gain = (float)pos / (float)fade_len;
-			buffer[ self->w_ptr[chn] ] = input[pos]; \
-			output[pos] += buffer[ self->r_ptr[chn] ] * (gain * SMOOTHGAIN);
-			INCREMENT_PTRS(chn);
-		}
+/* cache-line aligned delay ring */
+static float*
+dly_alloc(const size_t n)
+{
+	void* p = NULL;
+#ifdef _WIN32
+	p = _aligned_malloc(n * sizeof(float), DLY_ALIGN);
+#else
+	if (posix_memalign(&p, DLY_ALIGN, n * sizeof(float))) {
+		p = NULL;
+	}
+#endif
+	if (p) {
+		memset(p, 0, n * sizeof(float));
 	}
+	return (float*)p;
+}
 
-	if (target_amp != self->c_amp[chn]) {
-		for (; pos < n_samples; pos++) {
-			DLYWITHGAIN(SMOOTHGAIN)
-			INCREMENT_PTRS(chn);
+static void
+dly_free(float* p)
+{
+#ifdef _WIN32
+	_aligned_free(p);
+#else
+	free(p);
+#endif
+}
+
+/* delay change: cross-fade samples [0, n) from the previous tap
+ * (x_rptr) to the current one (r_ptr). Both taps are read from
+ * the ring, each input sample is written once. */
+static void
+dly_xfade(const DelayCore *d, Strip *s,
+		const float* const input, float* const output, const uint32_t n)
+{
+	XFade* const x = &s->x_dly;
+	const GainRamp* const g = &s->c_gain;
+	const float* const buffer = s->buffer;
+	const int size = d->dlymask + 1;
+	const int dly_prev = (s->w_ptr - s->x_rptr) & d->dlymask;
+	const uint32_t max_len = size - MAX(dly_prev, s->c_dly);
+	const float inv = 1.f / (float)x->len;
+
+	uint32_t pos = 0;
+	while (pos < n) {
+		const int rp = s->x_rptr;
+		const int rn = s->r_ptr;
+		uint32_t len = MIN(n - pos, max_len);
+		/* split at the ring wrap of either tap */
+		len = MIN(len, (uint32_t)(size - rp));
+		len = MIN(len, (uint32_t)(size - rn));
+
+		dly_write(d, s, &input[pos], len);
+
+		/* fade weights and gain are stepped per sample, from the
+		 * exact values at the start of each chunk. The gain ramps
+		 * for the first `nr` samples */
+		const uint32_t k   = x->pos + pos;
+		const uint32_t off = g->off + pos;
+		const uint32_t nr  = off < g->len ? MIN(len, g->len - off) : 0;
+		float g_out = (float)(x->len - k) * inv;
+		float g_in  = (float)k * inv;
+		float gain  = g->amp + g->step * (float)off;
+		uint32_t i = 0;
+		for (; i < nr; ++i, g_out -= inv, g_in += inv, gain += g->step) {
+			output[pos + i] = buffer[rp + i] * (g_out * gain) + buffer[rn + i] * (g_in * gain);
 		}
-	} else {
-		for (; pos < n_samples; pos++) {
-			DLYWITHGAIN(amp)
-			INCREMENT_PTRS(chn);
+		for (; i < len; ++i, g_out -= inv, g_in += inv) {
+			output[pos + i] = buffer[rp + i] * (g_out * g->target) + buffer[rn + i] * (g_in * g->target);
 		}
+
+		s->x_rptr = (rp + len) & d->dlymask;
+		s->r_ptr  = (rn + len) & d->dlymask;
+		pos += len;
+	}
+
+	x->pos += n;
+	if (x->pos >= x->len) {
+		x->len = x->pos = 0;
+	}
+}
+
+/* sum of the [ms] and [samples] delay ports, `delay` may be NULL */
+static inline int
+target_delay(const DelayCore *d, const float* const delay_ms, const float* const delay)
+{
+	const float ms = RAIL(*delay_ms, 0, MAXDELAY_MS);
+	int dly = (int) rintf(ms * d->samplerate / 1000.f);
+	if (delay) {
+		dly += (int) rintf(RAIL(*delay, 0, (float) MAXDELAY_SPL));
+	}
+	return MIN(dly, d->maxdelay - 1);
+}
+
+/* delay and amplify samples [0, end) of the cycle */
+static void
+process_channel(const DelayCore *d, Strip *s,
+		const float* const input, float* const output, const uint32_t end)
+{
+	uint32_t pos = 0;
+	XFade* const x = &s->x_dly;
+
+	if (x->len > 0) {
+		/* delay length changed, cross-fade between the taps */
+		pos = MIN(end, xfade_remain(x));
+		dly_xfade(d, s, input, output, pos);
+	}
+
+	dly_block(d, s, input, output, pos, end);
+}
+
+/* start transitions. Gain changes re-target the ramp from the
+ * current value. A delay change that arrives while a cross-fade
+ * is in progress is picked up once it has completed. */
+static inline void
+strip_update(const DelayCore *d, Strip *s, const float target, const int dly)
+{
+	GainRamp* const g = &s->c_gain;
+	if (g->target != target) {
+		g->amp    = gain_at(g, 0);
+		g->target = target;
+		g->len    = FADE_LEN;
+		g->off    = 0;
+		g->step   = (target - g->amp) / (float)FADE_LEN;
+	}
+
+	if (s->x_dly.len == 0 && s->c_dly != dly) {
+		s->x_rptr = s->r_ptr;
+		s->r_ptr  = (s->r_ptr + s->c_dly - dly) & d->dlymask;
+		s->c_dly  = dly;
+		s->x_dly.pos = 0;
+		s->x_dly.len = d->dly_fade_len;
 	}
-	self->c_amp[chn] = target_amp;
+}
+
+/* the gain ramp has processed `n` more samples */
+static inline void
+strip_advance(Strip *s, const uint32_t n)
+{
+	GainRamp* const g = &s->c_gain;
+	g->off = MIN(g->off + n, g->len);
 }
 
 static void
@@ -279,6 +720,427 @@ channel_map_change(BalanceControl *self, int mode,
 	}
 }
 
+/* output `meters` (of MTR_*) for `n` samples of output */
+static void
+meter_output(BalanceControl *self, const uint32_t meters,
+		const float* const out_l, const float* const out_r, const uint32_t n)
+{
+	if (meters & MTR_LEVEL_OUT) {
+		rms_run(&self->rms_out[C_LEFT],  &self->mk, out_l, n, &self->p_peak_out[C_LEFT],  &self->p_peak_outM[C_LEFT]);
+		rms_run(&self->rms_out[C_RIGHT], &self->mk, out_r, n, &self->p_peak_out[C_RIGHT], &self->p_peak_outM[C_RIGHT]);
+	}
+
+	if (meters & MTR_TRUEPEAK_OUT) {
+		tp_run(&self->tp_out[C_LEFT],  &self->mk, out_l, n, &self->p_peak_tp_out[C_LEFT]);
+		tp_run(&self->tp_out[C_RIGHT], &self->mk, out_r, n, &self->p_peak_tp_out[C_RIGHT]);
+	}
+
+	/* simple output phase correlation */
+	if (meters & MTR_PHASE) {
+		pc_run(&self->pc, &self->mk, out_l, out_r, n);
+	}
+
+	if (meters & MTR_LOUDNESS) {
+		lufs_run(self->lufs, &self->mk, out_l, out_r, n);
+	}
+}
+
+/* input level meters */
+static void
+meter_input(BalanceControl *self,
+		const float* const in_l, const float* const in_r, const uint32_t n)
+{
+	if (self->meters & MTR_LEVEL_IN) {
+		rms_run(&self->rms_in[C_LEFT],  &self->mk, in_l, n, &self->p_peak_in[C_LEFT],  &self->p_peak_inM[C_LEFT]);
+		rms_run(&self->rms_in[C_RIGHT], &self->mk, in_r, n, &self->p_peak_in[C_RIGHT], &self->p_peak_inM[C_RIGHT]);
+		self->p_energy_in[C_LEFT]  += rms_energy(&self->rms_in[C_LEFT]);
+		self->p_energy_in[C_RIGHT] += rms_energy(&self->rms_in[C_RIGHT]);
+	}
+	if (self->meters & MTR_TRUEPEAK_IN) {
+		tp_run(&self->tp_in[C_LEFT],  &self->mk, in_l, n, &self->p_peak_tp_in[C_LEFT]);
+		tp_run(&self->tp_in[C_RIGHT], &self->mk, in_r, n, &self->p_peak_tp_in[C_RIGHT]);
+	}
+}
+
+/* fused single-pass kernel: the delayed input is read once,
+ * gain and channel-map are applied in registers, the output is written
+ * once.
+ *
+ * The compiler vectorizes the plain loop behind a run-time overlap
+ * check, and falls back to scalar code if the host processes in-place.
+ * That case, and the metering variants, go by blocks of RMS_BLOCK
+ * samples instead: a block is read into local arrays before it is
+ * written, so the loops vectorize although the output aliases the input
+ * at the same index (possibly mono to stereo). The metering variants
+ * take the output level's RMS block sums and peak from the same arrays,
+ * instead of reading the output again.
+ */
+
+#define FUSED_MAP_0
+#define FUSED_MAP_1 r = l;
+#define FUSED_MAP_2 l = r;
+#define FUSED_MAP_3 { const float mem = l; l = r; r = mem; }
+#define FUSED_MAP_4 { const float mono = (l + r) / 2.0; l = r = mono; }
+
+#define FUSED_GAIN_STEADY(G, I) G.target
+#define FUSED_GAIN_RAMP(G, I)   gain_at(&G, pos + I)
+
+/* output level of whole blocks, written by the metering kernels */
+typedef struct {
+	float*   blk[CHANNELS];     // RMSIntegrator rings, at bidx
+	float*   tail[CHANNELS];
+	uint32_t tmask[RMS_BLOCK];  // ~0: in the window tail
+	float    peak[CHANNELS][4]; // per SIMD lane, NaN skipped
+} FusedMeter;
+
+/* sum of squares of a block and of its window tail, like sumsq16(),
+ * and the peak. The tail is masked rather than weighted, inf * 0 is NaN */
+static inline void
+fused_meter_block(FusedMeter* const fm, const int c, const uint32_t b, const float* const x)
+{
+	float* const pk = fm->peak[c];
+	float s = 0, t = 0;
+	for (uint32_t k = 0; k < RMS_BLOCK; ++k) {
+		const float a = fabsf(x[k]);
+		float q = x[k] * x[k];
+		uint32_t qb;
+		s += q;
+		memcpy(&qb, &q, sizeof(qb));
+		qb &= fm->tmask[k];
+		memcpy(&q, &qb, sizeof(q));
+		t += q;
+		pk[k % 4] = a > pk[k % 4] ? a : pk[k % 4];
+	}
+	fm->blk[c][b]  = s;
+	fm->tail[c][b] = t;
+}
+
+/* the output overlaps an input */
+static inline int
+fused_inplace(const float* const src_l, const float* const src_r,
+		const float* const out_l, const float* const out_r, const uint32_t n)
+{
+	const uintptr_t sz = n * sizeof(float);
+	const uintptr_t s[CHANNELS] = { (uintptr_t)src_l, (uintptr_t)src_r };
+	const uintptr_t o[CHANNELS] = { (uintptr_t)out_l, (uintptr_t)out_r };
+	for (uint32_t c = 0; c < CHANNELS; ++c) {
+		for (uint32_t d = 0; d < CHANNELS; ++d) {
+			if (s[c] < o[d] + sz && o[d] < s[c] + sz) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+#define FUSED_METER_0(B)
+#define FUSED_METER_1(B) \
+	fused_meter_block(fm, C_LEFT, B, bl); \
+	fused_meter_block(fm, C_RIGHT, B, br);
+
+/* one specialized kernel per channel-map mode, gain (steady, ramp) and
+ * output level metering (0, 1). Gains are copied to the stack: the
+ * output stores could otherwise alias them.
+ * Metering kernels meter the whole blocks of [0, n), which must be
+ * aligned with the integrator's blocks, see process_fused() */
+#define FUSED_KERNEL(MODE, GAIN, METER) \
+static void \
+fused_##MODE##_##GAIN##_##METER(BalanceControl *self, \
+		const float* const src_l, const float* const src_r, \
+		float* const out_l, float* const out_r, \
+		const uint32_t n, const uint32_t pos, FusedMeter* const fm) \
+{ \
+	(void)pos; /* steady gain */ \
+	(void)fm;  /* not metering */ \
+	const GainRamp g_l = self->strip[C_LEFT].c_gain; \
+	const GainRamp g_r = self->strip[C_RIGHT].c_gain; \
+	uint32_t i = 0; \
+	const uint32_t nblk = (METER || fused_inplace(src_l, src_r, out_l, out_r, n)) ? n / RMS_BLOCK : 0; \
+	for (uint32_t b = 0; b < nblk; ++b, i += RMS_BLOCK) { \
+		float bl[RMS_BLOCK], br[RMS_BLOCK]; \
+		for (uint32_t k = 0; k < RMS_BLOCK; ++k) { \
+			float l = src_l[i + k] * FUSED_GAIN_##GAIN(g_l, i + k); \
+			float r = src_r[i + k] * FUSED_GAIN_##GAIN(g_r, i + k); \
+			FUSED_MAP_##MODE \
+			bl[k] = l; \
+			br[k] = r; \
+		} \
+		for (uint32_t k = 0; k < RMS_BLOCK; ++k) { \
+			out_l[i + k] = bl[k]; \
+		} \
+		for (uint32_t k = 0; k < RMS_BLOCK; ++k) { \
+			out_r[i + k] = br[k]; \
+		} \
+		FUSED_METER_##METER(b) \
+	} \
+	for (; i < n; ++i) { \
+		float l = src_l[i] * FUSED_GAIN_##GAIN(g_l, i); \
+		float r = src_r[i] * FUSED_GAIN_##GAIN(g_r, i); \
+		FUSED_MAP_##MODE \
+		out_l[i] = l; \
+		out_r[i] = r; \
+	} \
+}
+
+#define FUSED_KERNEL_MODES(GAIN, METER) \
+	FUSED_KERNEL(1, GAIN, METER) \
+	FUSED_KERNEL(2, GAIN, METER) \
+	FUSED_KERNEL(3, GAIN, METER) \
+	FUSED_KERNEL(4, GAIN, METER)
+
+FUSED_KERNEL_MODES(STEADY, 0)
+FUSED_KERNEL_MODES(RAMP, 0)
+FUSED_KERNEL_MODES(STEADY, 1)
+FUSED_KERNEL_MODES(RAMP, 1)
+FUSED_KERNEL(0, STEADY, 1)
+FUSED_KERNEL(0, RAMP, 1)
+
+typedef void (*FusedKernel)(BalanceControl*,
+		const float*, const float*, float*, float*,
+		uint32_t n, uint32_t pos, FusedMeter* fm);
+
+/* without metering, mode 0 has no cross-channel work: NULL selects
+ * the per-channel SIMD gain kernels instead */
+#define FUSED_TABLE_MODES(GAIN, METER, MODE0) \
+	{ MODE0, \
+		fused_1_##GAIN##_##METER, \
+		fused_2_##GAIN##_##METER, \
+		fused_3_##GAIN##_##METER, \
+		fused_4_##GAIN##_##METER }
+
+/* indexed by [output level metering][ramp][channel-map mode] */
+static const FusedKernel fused_kernels[2][2][5] = {
+	{
+		FUSED_TABLE_MODES(STEADY, 0, NULL),
+		FUSED_TABLE_MODES(RAMP,   0, NULL),
+	}, {
+		FUSED_TABLE_MODES(STEADY, 1, fused_0_STEADY_1),
+		FUSED_TABLE_MODES(RAMP,   1, fused_0_RAMP_1),
+	},
+};
+
+/* length of the next segment: up to the next meter update */
+static inline uint32_t
+meter_segment(const BalanceControl *self, uint32_t cnt, uint32_t n)
+{
+	return MIN(n, self->update_period - cnt);
+}
+
+/* With meters on the audio thread, the output level is metered as the
+ * output is written, or right after (see MeterKernels.fuse_level), ahead
+ * of rt_meter_output(). The readings of each update are latched like the
+ * input's, see rt_meter_input() */
+typedef struct {
+	uint32_t cnt; // [samples] position in the update period
+	uint32_t u;   // latch of the current update
+} LevelAhead;
+
+/* `len` samples of output have been metered */
+static void
+rt_level_advance(BalanceControl *self, LevelAhead* const la, const uint32_t len)
+{
+	la->cnt += len;
+	if (la->cnt != self->update_period) {
+		return;
+	}
+	la->cnt = 0;
+	if (la->u < MTR_UPDATES) {
+		MeterLatch* l = &self->latch[la->u++];
+		for (uint32_t c=0; c < CHANNELS; ++c) {
+			l->peak_out[c]  = self->p_peak_out[c];
+			l->peakM_out[c] = self->p_peak_outM[c];
+			self->p_peak_out[c]  = -INFINITY;
+			self->p_peak_outM[c] = -INFINITY;
+		}
+	}
+}
+
+/* output level of [pos, end), read back from the output buffers */
+static void
+rt_level_output(BalanceControl *self, LevelAhead* const la, uint32_t pos, const uint32_t end)
+{
+	while (pos < end) {
+		const uint32_t len = meter_segment(self, la->cnt, end - pos);
+		rms_run(&self->rms_out[C_LEFT],  &self->mk, &self->output[C_LEFT][pos],  len, &self->p_peak_out[C_LEFT],  &self->p_peak_outM[C_LEFT]);
+		rms_run(&self->rms_out[C_RIGHT], &self->mk, &self->output[C_RIGHT][pos], len, &self->p_peak_out[C_RIGHT], &self->p_peak_outM[C_RIGHT]);
+		pos += len;
+		rt_level_advance(self, la, len);
+	}
+}
+
+/* since the last update */
+static void
+rt_level_end(BalanceControl *self, const LevelAhead* const la)
+{
+	MeterLatch* l = &self->latch[la->u];
+	for (uint32_t c=0; c < CHANNELS; ++c) {
+		l->peak_out[c]  = self->p_peak_out[c];
+		l->peakM_out[c] = self->p_peak_outM[c];
+	}
+}
+
+/* whole blocks the metering kernels can write at once,
+ * see rms_run() */
+static inline uint32_t
+fused_meter_blocks(const RMSIntegrator* const I, const uint32_t len)
+{
+	if (I->bpos != 0) {
+		return 0;
+	}
+	uint32_t nb = len / RMS_BLOCK;
+	if (nb > I->size - I->bidx) nb = I->size - I->bidx;
+	if (nb > I->size - I->wblk) nb = I->size - I->wblk;
+	return nb;
+}
+
+/* delay, gain and channel-map for [pos, n_samples),
+ * without delay or channel-map fades. Meters the output level
+ * if `la` is set. */
+static void
+process_fused(BalanceControl *self, const int ramp,
+		uint32_t pos, const uint32_t n_samples, LevelAhead* const la)
+{
+	uint32_t c;
+	if (la && self->rms_out[C_LEFT].wlen == 0) {
+		/* peak only, no block sums */
+		process_fused(self, ramp, pos, n_samples, NULL);
+		rt_level_output(self, la, pos, n_samples);
+		return;
+	}
+
+	const FusedKernel kernel = fused_kernels[la != NULL][ramp][self->c_monomode];
+
+	if (!kernel) {
+		/* nothing to fuse, use the per-channel SIMD gain kernels.
+		 * left in-place: possibly mono to stereo, process right first */
+		const int rev = self->input[0] == self->output[0];
+		for (c = 0; c < CHANNELS; ++c) {
+			const uint32_t chn = rev ? CHANNELS - 1 - c : c;
+			dly_block(&self->dly, &self->strip[chn], self->input[chn], self->output[chn], pos, n_samples);
+		}
+		return;
+	}
+
+	/* the write must not overtake the read-pointer */
+	const uint32_t max_len = self->dly.dlymask + 1 - MAX(self->strip[C_LEFT].c_dly, self->strip[C_RIGHT].c_dly);
+
+	while (pos < n_samples) {
+		const float* src[CHANNELS];
+		uint32_t len = MIN(n_samples - pos, max_len);
+		uint32_t nb = 0;
+
+		/* split at the ring wrap of the read-pointers */
+		for (c = 0; c < CHANNELS; ++c) {
+			if (self->strip[c].c_dly > 0) {
+				len = MIN(len, (uint32_t)(self->dly.dlymask + 1 - self->strip[c].r_ptr));
+			}
+		}
+
+		if (la) {
+			/* split at meter updates, and at the integrator's blocks
+			 * (both channels' are in lockstep). Samples outside whole
+			 * blocks are metered after */
+			const RMSIntegrator* const I = &self->rms_out[C_LEFT];
+			len = meter_segment(self, la->cnt, len);
+			nb = fused_meter_blocks(I, len);
+			len = nb > 0 ? nb * RMS_BLOCK : MIN(len, RMS_BLOCK - I->bpos);
+		}
+
+		for (c = 0; c < CHANNELS; ++c) {
+			const float* const input = &self->input[c][pos];
+			if (self->strip[c].c_dly == 0) {
+				/* read input directly, keep the ring warm (see dly_bypass) */
+				const uint32_t keep = MIN(len, (uint32_t)self->dly.maxdelay);
+				self->strip[c].w_ptr = (self->strip[c].w_ptr + len - keep) & self->dly.dlymask;
+				dly_write(&self->dly, &self->strip[c], &input[len - keep], keep);
+				self->strip[c].r_ptr = self->strip[c].w_ptr;
+				src[c] = input;
+			} else {
+				dly_write(&self->dly, &self->strip[c], input, len);
+				src[c] = &self->strip[c].buffer[self->strip[c].r_ptr];
+				self->strip[c].r_ptr = (self->strip[c].r_ptr + len) & self->dly.dlymask;
+			}
+		}
+
+		FusedMeter fm;
+		if (nb > 0) {
+			const uint32_t tpos = RMS_BLOCK - self->rms_out[C_LEFT].wtail;
+			for (uint32_t k = 0; k < RMS_BLOCK; ++k) {
+				fm.tmask[k] = k >= tpos ? ~0u : 0;
+			}
+			for (c = 0; c < CHANNELS; ++c) {
+				RMSIntegrator* const I = &self->rms_out[c];
+				fm.blk[c]  = &I->blk[I->bidx];
+				fm.tail[c] = &I->tail[I->bidx];
+				for (uint32_t k = 0; k < 4; ++k) {
+					fm.peak[c][k] = -INFINITY;
+				}
+			}
+		}
+
+		kernel(self, src[C_LEFT], src[C_RIGHT],
+				&self->output[C_LEFT][pos], &self->output[C_RIGHT][pos],
+				len, pos, nb > 0 ? &fm : NULL);
+
+		if (nb > 0) {
+			for (c = 0; c < CHANNELS; ++c) {
+				for (uint32_t k = 0; k < 4; ++k) {
+					if (fm.peak[c][k] > self->p_peak_out[c]) self->p_peak_out[c] = fm.peak[c][k];
+				}
+				rms_advance(&self->rms_out[c], nb, &self->p_peak_outM[c]);
+			}
+			rt_level_advance(self, la, len);
+		} else if (la) {
+			rt_level_output(self, la, pos, pos + len);
+		}
+		pos += len;
+	}
+}
+
+/* number of trailing zero samples */
+static inline uint32_t
+trailing_silence(const float* const buf, const uint32_t n)
+{
+	if (n == 0 || buf[n - 1] != 0) {
+		return 0;
+	}
+	/* common case: all silent, bitwise-or vectorizes */
+	uint32_t acc = 0;
+	for (uint32_t i = 0; i < n; ++i) {
+		uint32_t b;
+		memcpy(&b, &buf[i], sizeof(b));
+		acc |= b;
+	}
+	if ((acc & 0x7fffffff) == 0) {
+		return n;
+	}
+	uint32_t i = n;
+	while (i > 0 && buf[i - 1] == 0) {
+		--i;
+	}
+	return n - i;
+}
+
+/* what the meters would do with `n` samples of silent input and output,
+ * once the integrators have drained (all ring entries are zero) */
+static void
+meter_silence(BalanceControl *self, uint32_t n)
+{
+	if (self->meters & MTR_LOUDNESS) {
+		lufs_silence(self->lufs, n);
+	}
+	for (uint32_t c = 0; c < CHANNELS; ++c) {
+		self->p_peak_in[c]   = MAX(self->p_peak_in[c], 0.f);
+		self->p_peak_out[c]  = MAX(self->p_peak_out[c], 0.f);
+		rms_silence(&self->rms_in[c], n);
+		rms_silence(&self->rms_out[c], n);
+		self->p_peak_inM[c]  = MAX(self->p_peak_inM[c], 0.0);
+		self->p_peak_outM[c] = MAX(self->p_peak_outM[c], 0.0);
+		self->p_peak_tp_in[c]  = MAX(self->p_peak_tp_in[c], 0.f);
+		self->p_peak_tp_out[c] = MAX(self->p_peak_tp_out[c], 0.f);
+	}
+}
+
 static inline float gain_to_db(const float g) {
 	if (g <= 0) return -INFINITY;
 	return VALTODB(g);
@@ -288,93 +1150,1351 @@ static inline float db_to_gain(const float d) {
 	return pow(10, d/20.0);
 }
 
-static void reset_uicom(BalanceControl* self) {
-	int i;
-	for (i=0; i < CHANNELS; ++i) {
-		self->p_peak_in[i] = -INFINITY;
-		self->p_peak_out[i] = -INFINITY;
-		self->p_vpeak_in[i] = -INFINITY;
-		self->p_vpeak_out[i] = -INFINITY;
+/* queue a value for the UI, later values of the same key replace
+ * earlier ones. The worker collects them for its response */
+static inline void msgs_set(MeterMsgs* m, int key, float val) {
+	m->mask |= 1u << key;
+	m->val[key] = val;
+}
 
-		self->p_tme_in[i] = 0;
-		self->p_tme_out[i] = 0;
-		self->p_max_in[i] = -INFINITY;
-		self->p_max_out[i] = -INFINITY;
+static inline void meter_emit(BalanceControl* self, int key, float val) {
+	msgs_set(self->mw_out ? self->mw_out : &self->msgs, key, val);
+}
 
-		self->p_bal[i] = INFINITY;
-		self->p_dly[i] = -1;
+/* configuration and analysis results are sent once, as key/value messages */
+static inline int kv_key(int key) {
+	return (key >= CFG_INTEGRATE && key <= CFG_PHASE_WINDOW)
+		|| (key >= ALIGN_DELAY && key <= ALIGN_STATUS);
+}
+
+/* true if `val` does not differ visibly from the value last sent.
+ * Phase correlation and balance: 1 dB of deadband corresponds to .01 */
+static inline int meter_unchanged(const BalanceControl* self, int key, float val) {
+	const float prev = self->sent.val[key];
+	if (!(self->sent.mask & (1u << key))) {
+		return 0;
+	}
+	if (prev == val) {
+		return 1;
+	}
+	if (!isfinite(prev) || !isfinite(val)) {
+		return 0;
+	}
+	const float band = (key == PHASE_OUT || key == BALANCE_SUGGEST) ? .01f * self->deadband : self->deadband;
+	return fabsf(val - prev) < band;
+}
+
+/* balance setting that matches the level of both channels in gain
+ * mode `mode` (see process()), `ratio` [dB] > 0: left is louder */
+static float balance_suggest(const float ratio, const int mode) {
+	const float s = ratio > 0 ? 1.f : -1.f;
+	const float g = db_to_gain(-fabsf(ratio));
+	switch (mode) {
+		case 1: // amplitude ratio (1 - b) / (1 + b)
+			return s * (1.f - g) / (1.f + g);
+		case 2: // both channels, equal power
+			return s * MIN(.5f, 1.f - sqrtf(g));
+		default:
+			return s * (1.f - g);
+	}
+}
 
-		self->p_phase_outP   = 0;
-		self->p_phase_outN   = 0;
+/* the gain mode port is only read by the audio thread */
+static void bal_suggest(BalanceControl* self) {
+	MeterMsgs* m = &self->msgs;
+	const int mode = (int) *self->unitygain;
+	if (m->mask & (1u << BALANCE_RATIO)) {
+		self->bal_ratio = m->val[BALANCE_RATIO];
+		self->bal_valid = 1;
+	} else if (!self->bal_valid || mode == self->bal_mode) {
+		return;
+	}
+	self->bal_mode = mode;
+	msgs_set(m, BALANCE_SUGGEST, balance_suggest(self->bal_ratio, mode));
+}
 
-		memset(self->p_peak_inPi[i],  0, self->peak_integrate_max * sizeof(double));
-		memset(self->p_peak_outPi[i], 0, self->peak_integrate_max * sizeof(double));
+/* send queued values: configuration as key/value messages,
+ * meter readings that have changed as a single frame */
+static void meter_send(BalanceControl* self, uint32_t time) {
+	MeterMsgs* m = &self->msgs;
+	bal_suggest(self);
+	for (int k = 0; k < MTR_FRAME_KEYS && m->mask; ++k) {
+		const uint32_t bit = 1u << k;
+		if (!(m->mask & bit)) {
+			continue;
+		}
+		if (kv_key(k)) {
+			forge_kvcontrolmessage(&self->forge, &self->uris, k, m->val[k]);
+			m->mask &= ~bit;
+		} else if (meter_unchanged(self, k, m->val[k])) {
+			m->mask &= ~bit;
+		} else {
+			self->sent.val[k] = m->val[k];
+			self->sent.mask  |= bit;
+		}
+	}
+	if (m->mask) {
+		forge_meterframe(&self->forge, &self->uris, time, self->frame_seq++, m->mask, m->val);
+		m->mask = 0;
+	}
+}
+
+/* reset the given meters (MTR_*), integrators only if allocated */
+static void meter_reset(BalanceControl* self, uint32_t meters) {
+	int i;
+	for (i=0; i < CHANNELS; ++i) {
+		if (meters & MTR_LEVEL_IN) {
+			self->p_peak_in[i] = -INFINITY;
+			self->p_vpeak_in[i] = -INFINITY;
+			self->p_tme_in[i] = 0;
+			self->p_max_in[i] = -INFINITY;
+			self->p_peak_inM[i] = 0;
+			self->p_energy_in[i] = 0;
+			if (self->meters_mem & MTR_LEVEL_IN) {
+				rms_reset(&self->rms_in[i], self->peak_integrate_pref);
+			}
+		}
+		if (meters & MTR_LEVEL_OUT) {
+			self->p_peak_out[i] = -INFINITY;
+			self->p_vpeak_out[i] = -INFINITY;
+			self->p_tme_out[i] = 0;
+			self->p_max_out[i] = -INFINITY;
+			self->p_peak_outM[i] = 0;
+			if (self->meters_mem & MTR_LEVEL_OUT) {
+				rms_reset(&self->rms_out[i], self->peak_integrate_pref);
+			}
+		}
+	}
+
+	for (i=0; i < CHANNELS; ++i) {
+		if (meters & MTR_TRUEPEAK_IN) {
+			self->p_peak_tp_in[i] = -INFINITY;
+			self->p_tme_tp_in[i] = 0;
+			self->p_max_tp_in[i] = -INFINITY;
+			tp_reset(&self->tp_in[i]);
+		}
+		if (meters & MTR_TRUEPEAK_OUT) {
+			self->p_peak_tp_out[i] = -INFINITY;
+			self->p_tme_tp_out[i] = 0;
+			self->p_max_tp_out[i] = -INFINITY;
+			tp_reset(&self->tp_out[i]);
+		}
+	}
+
+	if (meters & MTR_LEVEL_IN) {
+		bal_reset(&self->bal);
+	}
+
+	if (meters & MTR_PHASE) {
+		pc_reset(&self->pc, self->phase_integrate_pref);
+	}
+
+	if ((meters & MTR_LOUDNESS) && (self->meters_mem & MTR_LOUDNESS)) {
+		lufs_reset(self->lufs);
+	}
+
+	if ((meters & MTR_ALL) == MTR_ALL) {
+		self->p_peakcnt  = 0;
+	}
+}
+
+/* allocate memory for `meters`, not in realtime context.
+ * Returns the meters that can run. */
+static uint32_t meter_alloc(const BalanceControl* self, uint32_t meters,
+		RMSIntegrator* rms_in, RMSIntegrator* rms_out, Loudness** lufs) {
+	uint32_t rv = meters & MTR_NOALLOC;
+	int err = 0;
+	if (meters & MTR_LEVEL_IN) {
+		for (int i=0; i < CHANNELS; ++i) {
+			err |= rms_init(&rms_in[i], self->peak_integrate_max);
+		}
+		if (err) {
+			for (int i=0; i < CHANNELS; ++i) {
+				rms_free(&rms_in[i]);
+			}
+		} else {
+			rv |= MTR_LEVEL_IN;
+		}
+	}
+	err = 0;
+	if (meters & MTR_LEVEL_OUT) {
+		for (int i=0; i < CHANNELS; ++i) {
+			err |= rms_init(&rms_out[i], self->peak_integrate_max);
+		}
+		if (err) {
+			for (int i=0; i < CHANNELS; ++i) {
+				rms_free(&rms_out[i]);
+			}
+		} else {
+			rv |= MTR_LEVEL_OUT;
+		}
+	}
+	if (meters & MTR_LOUDNESS) {
+		*lufs = (Loudness*) malloc(sizeof(Loudness));
+		if (*lufs) {
+			lufs_init(*lufs, self->samplerate);
+			rv |= MTR_LOUDNESS;
+		}
+	}
+	if (rv != meters) {
+		fprintf(stderr, "BLClv2 error: out of memory\n");
+	}
+	return rv;
+}
+
+/* free memory returned by meter_alloc() */
+static void meter_release(uint32_t meters, RMSIntegrator* rms_in, RMSIntegrator* rms_out, Loudness* lufs) {
+	for (int i=0; i < CHANNELS; ++i) {
+		if (meters & MTR_LEVEL_IN) {
+			rms_free(&rms_in[i]);
+		}
+		if (meters & MTR_LEVEL_OUT) {
+			rms_free(&rms_out[i]);
+		}
+	}
+	if (meters & MTR_LOUDNESS) {
+		free(lufs);
+	}
+}
+
+/* run the requested meters that have memory, reset meters that start */
+static void meters_update(BalanceControl* self) {
+	const uint32_t missing = self->meters_req & ~self->meters_mem;
+	if (missing && self->mw_out) {
+		/* in the worker, allocate now */
+		self->meters_mem |= meter_alloc(self, missing, self->rms_in, self->rms_out, &self->lufs);
+	}
+	const uint32_t on = self->meters_req & self->meters_mem;
+	meter_reset(self, on & ~self->meters);
+	self->meters = on;
+}
+
+static void reset_uicom(BalanceControl* self) {
+	for (int i=0; i < CHANNELS; ++i) {
+		self->p_bal[i] = INFINITY;
+		self->p_dly[i] = -1;
+	}
+	self->sent.mask = 0;
+	self->scope_n = self->scope_acc = 0;
+	self->scope_ready = 0;
+}
+
+/* per-update ballistics from the settings in real time */
+static void meter_timing(BalanceControl* self) {
+	self->meter_falloff = self->meter_falloff_pref / (double)self->update_rate;
+	self->peak_hold = self->peak_hold_pref * (double)self->update_rate;
+
+	const uint32_t period = MAX(1, rint(self->samplerate / self->update_rate));
+	__atomic_store_n(&self->update_period, period, __ATOMIC_RELAXED);
+	self->p_peakcnt = MIN(self->p_peakcnt, period - 1);
+}
+
+static void send_cfg_to_ui(BalanceControl* self) {
+	meter_emit(self, CFG_INTEGRATE, self->peak_integrate_pref / self->samplerate);
+	meter_emit(self, CFG_FALLOFF, self->meter_falloff_pref);
+	meter_emit(self, CFG_HOLDTIME, self->peak_hold_pref);
+	meter_emit(self, CFG_PHASE_WINDOW, self->phase_integrate_pref / self->samplerate);
+}
+
+static void update_meter_cfg(BalanceControl* self, int key, float val) {
+	switch (key) {
+		case 0:
+			if (val >=0 && val * self->samplerate <= self->peak_integrate_max) {
+				__atomic_store_n(&self->peak_integrate_pref, (int)(val * self->samplerate), __ATOMIC_RELAXED);
+			}
+			meter_reset(self, MTR_MASK & ~MTR_LOUDNESS);
+			break;
+		case 1:
+			self->meter_falloff_pref = MIN(MAX(0, val), 1000);
+			meter_timing(self);
+			break;
+		case 2:
+			self->peak_hold_pref = MIN(MAX(0, val), 60);
+			meter_timing(self);
+			break;
+		case 3:
+			for (int i=0; i < CHANNELS; ++i) {
+				if ( ((int)val)&1) {
+					self->p_max_in[i] = -INFINITY;
+					self->p_max_tp_in[i] = -INFINITY;
+				}
+				if ( ((int)val)&2) {
+					self->p_max_out[i] = -INFINITY;
+					self->p_max_tp_out[i] = -INFINITY;
+				}
+			}
+			if (self->meters & MTR_LEVEL_IN) {
+				meter_emit(self, PEAK_IN_LEFT, self->p_max_in[C_LEFT]);
+				meter_emit(self, PEAK_IN_RIGHT, self->p_max_in[C_RIGHT]);
+			}
+			if (self->meters & MTR_LEVEL_OUT) {
+				meter_emit(self, PEAK_OUT_LEFT, self->p_max_out[C_LEFT]);
+				meter_emit(self, PEAK_OUT_RIGHT, self->p_max_out[C_RIGHT]);
+			}
+			if (self->meters & MTR_TRUEPEAK_IN) {
+				meter_emit(self, TRUEPEAK_IN_LEFT, self->p_max_tp_in[C_LEFT]);
+				meter_emit(self, TRUEPEAK_IN_RIGHT, self->p_max_tp_in[C_RIGHT]);
+			}
+			if (self->meters & MTR_TRUEPEAK_OUT) {
+				meter_emit(self, TRUEPEAK_OUT_LEFT, self->p_max_tp_out[C_LEFT]);
+				meter_emit(self, TRUEPEAK_OUT_RIGHT, self->p_max_tp_out[C_RIGHT]);
+			}
+			break;
+		case 4:
+			if (val >= PHASE_INTEGRATION_MIN && val <= PHASE_INTEGRATION_MAX) {
+				/* also read by the audio thread (idle detection) */
+				__atomic_store_n(&self->phase_integrate_pref, (int)(val * self->samplerate), __ATOMIC_RELAXED);
+				pc_reset(&self->pc, self->phase_integrate_pref);
+			}
+			break;
+		case 7:
+			/* restart integrated loudness and loudness range */
+			meter_reset(self, MTR_LOUDNESS);
+			break;
+		case 9:
+			if (val >= UPDATE_FREQ_MIN && val <= UPDATE_FREQ_MAX) {
+				self->update_rate = val;
+				meter_timing(self);
+			}
+			break;
+		case 11:
+			/* restart the long-term balance statistics */
+			bal_reset(&self->bal);
+			break;
+
+		default:
+			break;
+	}
+}
+
+/* apply restored state[0..3] */
+static void apply_meter_state(BalanceControl* self, const float* const state) {
+	int peak_integrate  = state[0] * self->samplerate;
+	int phase_integrate = state[3] * self->samplerate;
+
+	peak_integrate = MAX(0, peak_integrate);
+	peak_integrate = MIN(peak_integrate, self->peak_integrate_max);
+	__atomic_store_n(&self->peak_integrate_pref, peak_integrate, __ATOMIC_RELAXED);
+
+	self->meter_falloff_pref = MIN(MAX(0, state[1]), 1000);
+	self->peak_hold_pref = MIN(MAX(0, state[2]), 60);
+	meter_timing(self);
+
+	phase_integrate = MAX(PHASE_INTEGRATION_MIN * self->samplerate, phase_integrate);
+	phase_integrate = MIN(PHASE_INTEGRATION_MAX * self->samplerate, phase_integrate);
+	__atomic_store_n(&self->phase_integrate_pref, phase_integrate, __ATOMIC_RELAXED);
+	meter_reset(self, MTR_MASK);
+	send_cfg_to_ui(self);
+}
+
+/* abs peak hold */
+#define PKM(A,CHN,ID) \
+{ \
+	const float peak = VALTODB(self->p_peak_##A[CHN]); \
+	if (peak > self->p_max_##A[CHN]) { \
+		self->p_max_##A[CHN] = peak; \
+		self->p_tme_##A[CHN] = 0; \
+		meter_emit(self, ID, self->p_max_##A[CHN]); \
+	} else if (self->peak_hold <= 0) { \
+		(self->p_tme_##A[CHN])=0; /* infinite hold */ \
+	} else if (self->p_tme_##A[CHN] <= self->peak_hold) { \
+		(self->p_tme_##A[CHN])++; \
+	} else if (self->meter_falloff == 0) { \
+		self->p_max_##A[CHN] = peak; \
+		meter_emit(self, ID, self->p_max_##A[CHN]); \
+	} else { \
+		self->p_max_##A[CHN] -= self->meter_falloff; \
+		self->p_max_##A[CHN] = MAX(peak, self->p_max_##A[CHN]); \
+		meter_emit(self, ID, self->p_max_##A[CHN]); \
+	} \
+}
+
+/* RMS meter */
+#define PKF(A,CHN,ID) \
+{ \
+	float dbp = VALTODB(sqrt(2.0 * self->p_peak_##A##M[CHN])); \
+	if (dbp > self->p_vpeak_##A[CHN]) { \
+		self->p_vpeak_##A[CHN] = dbp; \
+	} else if (self->meter_falloff == 0) { \
+		self->p_vpeak_##A[CHN] = dbp; \
+	} else { \
+		self->p_vpeak_##A[CHN] -= self->meter_falloff; \
+		self->p_vpeak_##A[CHN] = MAX(dbp, self->p_vpeak_##A[CHN]); \
+	} \
+	meter_emit(self, ID, (self->p_vpeak_##A [CHN])); \
+}
+
+/* an update period has been metered, report peaks to UI */
+static void
+meter_report(BalanceControl *self)
+{
+	if (self->meters & MTR_LEVEL_IN) {
+		PKF(in,  C_LEFT,  METER_IN_LEFT)
+		PKF(in,  C_RIGHT, METER_IN_RIGHT);
+	}
+	if (self->meters & MTR_LEVEL_OUT) {
+		PKF(out, C_LEFT,  METER_OUT_LEFT);
+		PKF(out, C_RIGHT, METER_OUT_RIGHT);
+	}
+
+	if (self->meters & MTR_LEVEL_IN) {
+		PKM(in,  C_LEFT,  PEAK_IN_LEFT);
+		PKM(in,  C_RIGHT, PEAK_IN_RIGHT);
+
+		const double n = self->update_period;
+		bal_add(&self->bal, self->p_energy_in[C_LEFT] / n, self->p_energy_in[C_RIGHT] / n);
+		if (self->bal.cnt > 0) {
+			meter_emit(self, BALANCE_RATIO, bal_ratio(&self->bal));
+		}
+	}
+	if (self->meters & MTR_LEVEL_OUT) {
+		PKM(out, C_LEFT,  PEAK_OUT_LEFT);
+		PKM(out, C_RIGHT, PEAK_OUT_RIGHT);
+	}
+
+	if (self->meters & MTR_TRUEPEAK_IN) {
+		PKM(tp_in,  C_LEFT,  TRUEPEAK_IN_LEFT);
+		PKM(tp_in,  C_RIGHT, TRUEPEAK_IN_RIGHT);
+	}
+	if (self->meters & MTR_TRUEPEAK_OUT) {
+		PKM(tp_out, C_LEFT,  TRUEPEAK_OUT_LEFT);
+		PKM(tp_out, C_RIGHT, TRUEPEAK_OUT_RIGHT);
+	}
+
+	if (self->meters & MTR_PHASE) {
+#define RMSF(A) sqrt( ( (A) / (double)pc_window(&self->pc) ) + 1.0e-12 )
+		double phase = 0.0;
+		double phasp, phasn;
+		pc_read(&self->pc, &phasp, &phasn);
+		const double phasdiv = phasp + phasn;
+		if (phasdiv >= 1.0e-6) {
+			phase = (RMSF(phasp) - RMSF(phasn)) / RMSF(phasdiv);
+		} else if (phasp > .001 && phasn > .001) {
+			phase = 1.0;
+		}
+
+		meter_emit(self, PHASE_OUT, phase);
+	}
+
+	if (self->meters & MTR_LOUDNESS) {
+		meter_emit(self, LOUDNESS_MOMENTARY,  self->lufs->momentary);
+		meter_emit(self, LOUDNESS_SHORT,      self->lufs->shortterm);
+		meter_emit(self, LOUDNESS_INTEGRATED, self->lufs->integrated);
+		meter_emit(self, LOUDNESS_RANGE,      self->lufs->range);
+	}
+
+	for (uint32_t c=0; c < CHANNELS; ++c) {
+		self->p_peak_in[c] = -INFINITY;
+		self->p_peak_out[c] = -INFINITY;
+		self->p_peak_inM[c] = -INFINITY;
+		self->p_peak_outM[c] = -INFINITY;
+		self->p_peak_tp_in[c] = -INFINITY;
+		self->p_peak_tp_out[c] = -INFINITY;
+		self->p_energy_in[c] = 0;
+	}
+}
+
+/* meter `n` samples of input and output, or of silence (in_l == NULL),
+ * report at each update. The worker has both streams at hand */
+static void
+meter_run(BalanceControl *self,
+		const float* const in_l, const float* const in_r,
+		const float* const out_l, const float* const out_r, const uint32_t n)
+{
+	uint32_t pos = 0;
+	while (pos < n) {
+		const uint32_t len = meter_segment(self, self->p_peakcnt, n - pos);
+		if (in_l) {
+			meter_input(self, &in_l[pos], &in_r[pos], len);
+			meter_output(self, self->meters, &out_l[pos], &out_r[pos], len);
+		} else {
+			meter_silence(self, len);
+		}
+		pos += len;
+		self->p_peakcnt += len;
+		if (self->p_peakcnt == self->update_period) {
+			self->p_peakcnt = 0;
+			meter_report(self);
+		}
+	}
+}
+
+/* The audio thread meters the input before in-place processing
+ * overwrites it, the output level as it is written (see
+ * process_fused()), and the other output meters after.
+ * rt_meter_input() and rt_level_output() keep the peaks of each update
+ * of the cycle, rt_meter_output() puts them back to report at the same
+ * sample positions. */
+static void
+rt_meter_input(BalanceControl *self, const uint32_t n)
+{
+	uint32_t pos = 0, cnt = self->p_peakcnt, u = 0;
+	while (pos < n) {
+		const uint32_t len = meter_segment(self, cnt, n - pos);
+		meter_input(self, &self->input[C_LEFT][pos], &self->input[C_RIGHT][pos], len);
+		pos += len;
+		cnt += len;
+		if (cnt == self->update_period) {
+			cnt = 0;
+			if (u < MTR_UPDATES) {
+				MeterLatch* l = &self->latch[u++];
+				for (uint32_t c=0; c < CHANNELS; ++c) {
+					l->peak[c]   = self->p_peak_in[c];
+					l->peakM[c]  = self->p_peak_inM[c];
+					l->tp[c]     = self->p_peak_tp_in[c];
+					l->energy[c] = self->p_energy_in[c];
+					self->p_peak_in[c]    = -INFINITY;
+					self->p_peak_inM[c]   = -INFINITY;
+					self->p_peak_tp_in[c] = -INFINITY;
+					self->p_energy_in[c]  = 0;
+				}
+			}
+		}
+	}
+	/* since the last update */
+	MeterLatch* l = &self->latch[u];
+	for (uint32_t c=0; c < CHANNELS; ++c) {
+		l->peak[c]   = self->p_peak_in[c];
+		l->peakM[c]  = self->p_peak_inM[c];
+		l->tp[c]     = self->p_peak_tp_in[c];
+		l->energy[c] = self->p_energy_in[c];
+	}
+}
+
+static inline void
+rt_restore(BalanceControl *self, const MeterLatch* const l)
+{
+	for (uint32_t c=0; c < CHANNELS; ++c) {
+		self->p_peak_in[c]    = l->peak[c];
+		self->p_peak_inM[c]   = l->peakM[c];
+		self->p_peak_tp_in[c] = l->tp[c];
+		self->p_energy_in[c]  = l->energy[c];
+	}
+	if (self->meters & MTR_LEVEL_OUT) {
+		for (uint32_t c=0; c < CHANNELS; ++c) {
+			self->p_peak_out[c]  = l->peak_out[c];
+			self->p_peak_outM[c] = l->peakM_out[c];
+		}
+	}
+}
+
+/* meter the output, or silence (idle), and send a frame at each update.
+ * The output level has been metered already, unless idle */
+static void
+rt_meter_output(BalanceControl *self, const uint32_t n, const int idle)
+{
+	uint32_t pos = 0, u = 0;
+	while (pos < n) {
+		const uint32_t len = meter_segment(self, self->p_peakcnt, n - pos);
+		if (idle) {
+			meter_silence(self, len);
+		} else {
+			meter_output(self, self->meters & ~MTR_LEVEL_OUT,
+					&self->output[C_LEFT][pos], &self->output[C_RIGHT][pos], len);
+		}
+		pos += len;
+		self->p_peakcnt += len;
+		if (self->p_peakcnt == self->update_period) {
+			self->p_peakcnt = 0;
+			if (u < MTR_UPDATES) {
+				if (!idle) {
+					rt_restore(self, &self->latch[u]);
+				}
+				++u;
+				meter_report(self);
+				meter_send(self, pos - 1);
+			}
+		}
+	}
+	if (!idle) {
+		rt_restore(self, &self->latch[u]);
+	}
+}
+
+/* meter commands, executed by whichever thread owns the meters */
+static void
+meter_command(BalanceControl *self, int type, uint32_t arg, const float* const data)
+{
+	switch (type) {
+		case MW_REC_SILENCE:
+			meter_run(self, NULL, NULL, NULL, NULL, arg);
+			break;
+		case MW_REC_CFG:
+			update_meter_cfg(self, arg, data[0]);
+			break;
+		case MW_REC_STATE:
+			apply_meter_state(self, data);
+			break;
+		case MW_REC_RESET:
+			meter_reset(self, MTR_MASK);
+			send_cfg_to_ui(self);
+			break;
+		case MW_REC_MASK:
+			self->meters_req = arg;
+			meters_update(self);
+			break;
+	}
+}
+
+/*** metering worker ***/
+
+/* the audio thread runs the meters (the worker is off or starting) */
+static inline int
+mw_rt_meters(const BalanceControl *self)
+{
+	return self->mw_state == MW_OFF || self->mw_state == MW_STARTING;
+}
+
+/* the audio thread queues records for the worker, until the ring is drained */
+static inline int
+mw_queueing(const BalanceControl *self)
+{
+	return self->mw_state == MW_ON || self->mw_state == MW_STOPPING;
+}
+
+/* queue a record: header and `len` floats of data, if at least
+ * `reserve` floats of space remain afterwards */
+static int
+mw_push(BalanceControl *self, int type, uint32_t arg, const float* const data, uint32_t len, uint32_t reserve)
+{
+	AnalysisRing* const R = &self->mw_buf->ring;
+	if (ar_write_space(R) < 2 + len + reserve) {
+		return -1;
+	}
+	const float hdr[2] = { (float)type, (float)arg };
+	ar_put(R, 0, hdr, 2);
+	if (len > 0) {
+		ar_put(R, 2, data, len);
+	}
+	ar_commit(R, 2 + len);
+	return 0;
+}
+
+/* move pending commands to the ring, in order, as far as they fit.
+ * Audio records leave MW_CMD_RESERVE floats for them, so this only
+ * stalls while the worker is behind. */
+static void
+mw_cmd_flush(BalanceControl *self)
+{
+	uint32_t i = 0;
+	for (; i < self->mw_ncmd; ++i) {
+		const MeterCmd* const c = &self->mw_cmd[i];
+		if (mw_push(self, c->type, c->arg, c->data, c->len, 0)) {
+			break;
+		}
+	}
+	if (i > 0) {
+		self->mw_ncmd -= i;
+		memmove(self->mw_cmd, &self->mw_cmd[i], self->mw_ncmd * sizeof(MeterCmd));
+		self->mw_ctl = 1;
+	}
+}
+
+/* commands are never dropped: a command replaces the pending one of
+ * the same kind (cfg: same key) and moves to the end of the queue,
+ * which therefore holds at most MW_CMD_MAX entries */
+static void
+mw_cmd_queue(BalanceControl *self, int type, uint32_t arg, const float* const data, uint32_t len)
+{
+	uint32_t n = self->mw_ncmd;
+	for (uint32_t i = 0; i < n; ++i) {
+		if (self->mw_cmd[i].type == type && (type != MW_REC_CFG || self->mw_cmd[i].arg == arg)) {
+			--n;
+			memmove(&self->mw_cmd[i], &self->mw_cmd[i + 1], (n - i) * sizeof(MeterCmd));
+			break;
+		}
+	}
+	MeterCmd* const c = &self->mw_cmd[n];
+	c->type = type;
+	c->arg  = arg;
+	c->len  = len;
+	for (uint32_t i = 0; i < len; ++i) {
+		c->data[i] = data[i];
+	}
+	self->mw_ncmd = n + 1;
+	mw_cmd_flush(self);
+}
+
+/* run a meter command now, or queue it for the worker */
+static void
+meter_ctl(BalanceControl *self, int type, uint32_t arg, const float* const data, uint32_t len)
+{
+	if (mw_rt_meters(self)) {
+		meter_command(self, type, arg, data);
+	} else {
+		mw_cmd_queue(self, type, arg, data, len);
+	}
+}
+
+/* queue the input of this cycle, one record per MW_CHUNK samples.
+ * The records are completed and published by mw_queue_output().
+ * Streams of meters that are not running are left unset. */
+static void
+mw_queue_input(BalanceControl *self, const uint32_t n_samples)
+{
+	AnalysisRing* const R = &self->mw_buf->ring;
+	const uint32_t nrec = (n_samples + MW_CHUNK - 1) / MW_CHUNK;
+
+	self->mw_rec = ar_write_space(R) >= 2 * nrec + 2 * CHANNELS * n_samples + MW_CMD_RESERVE;
+	if (!self->mw_rec) {
+		return;
+	}
+
+	uint32_t off = 0;
+	for (uint32_t pos = 0; pos < n_samples; pos += MW_CHUNK) {
+		const uint32_t len = MIN(MW_CHUNK, n_samples - pos);
+		const float hdr[2] = { (float)MW_REC_AUDIO, (float)len };
+		ar_put(R, off, hdr, 2);
+		for (uint32_t c=0; c < CHANNELS && (self->meters_want & (MTR_LEVEL_IN | MTR_TRUEPEAK_IN)); ++c) {
+			ar_put(R, off + 2 + c * len, &self->input[c][pos], len);
+		}
+		off += 2 + 2 * CHANNELS * len;
+	}
+}
+
+static void
+mw_queue_output(BalanceControl *self, const uint32_t n_samples)
+{
+	if (!self->mw_rec) {
+		return;
+	}
+	AnalysisRing* const R = &self->mw_buf->ring;
+
+	uint32_t off = 0;
+	for (uint32_t pos = 0; pos < n_samples; pos += MW_CHUNK) {
+		const uint32_t len = MIN(MW_CHUNK, n_samples - pos);
+		for (uint32_t c=0; c < CHANNELS && (self->meters_want & (MTR_LEVEL_OUT | MTR_PHASE | MTR_TRUEPEAK_OUT | MTR_LOUDNESS)); ++c) {
+			ar_put(R, off + 2 + (CHANNELS + c) * len, &self->output[c][pos], len);
+		}
+		off += 2 + 2 * CHANNELS * len;
+	}
+	ar_commit(R, off);
+	self->mw_queued += n_samples;
+	self->mw_rec = 0;
+}
+
+static int
+mw_schedule(BalanceControl *self, int type, uint32_t meters)
+{
+	const MeterJob job = { type, self->mw_buf, meters, NULL, NULL, 0 };
+	if (self->schedule->schedule_work(self->schedule->handle, sizeof(job), &job) != LV2_WORKER_SUCCESS) {
+		return -1;
+	}
+	++self->mw_pending;
+	return 0;
+}
+
+/* select the meters to run (MTR_*), 0: all */
+static void
+meter_select(BalanceControl *self, const float val)
+{
+	uint32_t meters = (val > 0 && val <= MTR_MASK) ? (uint32_t)val : (uint32_t)MTR_ALL;
+	if (meters == self->meters_want) {
+		return;
+	}
+	self->meters_want = meters;
+	meter_ctl(self, MW_REC_MASK, meters, NULL, 0);
+}
+
+/* start or stop the worker, allocate meter memory.
+ * Called at the start of each cycle */
+static void
+mw_update(BalanceControl *self)
+{
+	switch (self->mw_state) {
+		case MW_OFF:
+			if (!self->schedule || self->mw_pending > 0) {
+				break;
+			}
+			if (self->mw_want) {
+				if (mw_schedule(self, MW_JOB_ALLOC, 0) == 0) {
+					self->mw_state = MW_STARTING;
+				}
+			} else if (self->meters_req & ~self->meters_mem) {
+				mw_schedule(self, MW_JOB_METERS, self->meters_req & ~self->meters_mem);
+			}
+			break;
+		case MW_ON:
+			mw_cmd_flush(self);
+			if (!self->mw_want) {
+				self->mw_state = MW_STOPPING;
+			}
+			break;
+		case MW_STOPPING:
+			/* audio is queued until the worker has processed everything
+			 * (the drain job is scheduled at the end of each cycle), then
+			 * the ring is freed and the audio thread continues with the
+			 * worker's meter state, from this cycle on */
+			mw_cmd_flush(self);
+			if (self->mw_pending > 0 || self->mw_ncmd > 0 || ar_read_space(&self->mw_buf->ring) > 0) {
+				break;
+			}
+			if (mw_schedule(self, MW_JOB_FREE, 0) == 0) {
+				self->mw_buf = NULL;
+				self->mw_state = MW_OFF;
+			}
+			break;
+		default:
+			break;
+	}
+}
+
+static MeterWorkerBuf*
+mw_alloc(const BalanceControl *self)
+{
+	MeterWorkerBuf* b = (MeterWorkerBuf*) calloc(1, sizeof(MeterWorkerBuf));
+	if (!b) {
+		return NULL;
+	}
+	uint32_t size = 1;
+	while (size < 2 * CHANNELS * MW_RING_TIME * self->samplerate) {
+		size <<= 1;
+	}
+	b->ring.size = size;
+	b->ring.buf  = (float*) malloc(size * sizeof(float));
+	b->scratch   = (float*) malloc(2 * CHANNELS * MW_CHUNK * sizeof(float));
+	if (!b->ring.buf || !b->scratch) {
+		free(b->ring.buf);
+		free(b->scratch);
+		free(b);
+		return NULL;
+	}
+	return b;
+}
+
+static void
+mw_free(MeterWorkerBuf* b)
+{
+	if (b) {
+		free(b->ring.buf);
+		free(b->scratch);
+	}
+	free(b);
+}
+
+/* worker: run the meters on all queued records */
+static void
+mw_run(BalanceControl *self, MeterWorkerBuf* b)
+{
+	AnalysisRing* const R = &b->ring;
+	uint32_t avail = ar_read_space(R);
+
+	/* meters requested before the worker took over */
+	meters_update(self);
+
+	while (avail >= 2) {
+		float hdr[2];
+		ar_get(R, 0, hdr, 2);
+		const int type = hdr[0];
+		const uint32_t arg = hdr[1];
+		uint32_t len = 0;
+
+		switch (type) {
+			case MW_REC_AUDIO:
+				len = 2 * CHANNELS * arg;
+				ar_get(R, 2, b->scratch, len);
+				meter_run(self, b->scratch, &b->scratch[arg],
+						&b->scratch[CHANNELS * arg], &b->scratch[(CHANNELS + 1) * arg], arg);
+				break;
+			case MW_REC_CFG:
+				len = 1;
+				break;
+			case MW_REC_STATE:
+				len = 4;
+				break;
+		}
+		if (type != MW_REC_AUDIO) {
+			ar_get(R, 2, b->scratch, len);
+			meter_command(self, type, arg, b->scratch);
+		}
+		ar_release(R, 2 + len);
+		avail -= 2 + len;
+	}
+}
+
+/*** alignment analysis ***/
+
+static AlignCapture*
+al_alloc(const BalanceControl *self)
+{
+	AlignCapture* a = (AlignCapture*) calloc(1, sizeof(AlignCapture));
+	if (!a) {
+		return NULL;
+	}
+	a->len = ALIGN_TIME * self->samplerate;
+	float* const buf = (float*) malloc(CHANNELS * a->len * sizeof(float));
+	if (!buf) {
+		free(a);
+		return NULL;
+	}
+	for (uint32_t c=0; c < CHANNELS; ++c) {
+		a->buf[c] = &buf[c * a->len];
+	}
+	return a;
+}
+
+static void
+al_free(AlignCapture* a)
+{
+	if (a) {
+		free(a->buf[0]);
+	}
+	free(a);
+}
+
+static int
+al_schedule(BalanceControl *self, int type)
+{
+	const MeterJob job = { type, NULL, 0, self->al_cap, NULL, 0 };
+	return self->schedule->schedule_work(self->schedule->handle, sizeof(job), &job) == LV2_WORKER_SUCCESS ? 0 : -1;
+}
+
+/* send the result to the UI. ALIGN_STATUS is sent last:
+ * 0 no estimate, otherwise the requested mode */
+static void
+al_report(BalanceControl *self, const AlignResult* const res)
+{
+	/* not meter_emit(), the worker may be collecting meter values */
+	MeterMsgs* const m = &self->msgs;
+	if (res) {
+		msgs_set(m, ALIGN_CONFIDENCE, res->confidence);
+	}
+	if (res && res->confidence >= ALIGN_MIN_CONFIDENCE) {
+		msgs_set(m, ALIGN_DELAY, res->delay / self->samplerate);
+		msgs_set(m, ALIGN_POLARITY, res->polarity);
+		msgs_set(m, ALIGN_STATUS, self->al_mode);
+	} else {
+		msgs_set(m, ALIGN_STATUS, 0);
+	}
+}
+
+/* cfg key 10: start an analysis, 1: analyze, 2: analyze and apply,
+ * 0: cancel the capture */
+static void
+al_request(BalanceControl *self, const float val)
+{
+	if (val < 1) {
+		if (self->al_state == AL_CAPTURE) {
+			self->al_state = AL_IDLE;
+		}
+		return;
+	}
+	if (self->al_state != AL_IDLE) {
+		return;
+	}
+	self->al_mode = val >= 2 ? 2 : 1;
+	if (!self->schedule) {
+		/* no analysis in the audio thread */
+		al_report(self, NULL);
+	} else if (self->al_cap) {
+		self->al_pos   = 0;
+		self->al_state = AL_CAPTURE;
+	} else if (al_schedule(self, AL_JOB_ALLOC) == 0) {
+		self->al_state = AL_ALLOC;
+	} else {
+		al_report(self, NULL);
+	}
+}
+
+/* copy the input, before in-place processing overwrites it */
+static void
+al_capture(BalanceControl *self, const uint32_t n_samples)
+{
+	AlignCapture* const a = self->al_cap;
+	const uint32_t n = MIN(n_samples, a->len - self->al_pos);
+	for (uint32_t c=0; c < CHANNELS; ++c) {
+		memcpy(&a->buf[c][self->al_pos], self->input[c], n * sizeof(float));
+	}
+	self->al_pos += n;
+	if (self->al_pos < a->len) {
+		return;
+	}
+	if (al_schedule(self, AL_JOB_RUN) == 0) {
+		self->al_state = AL_ANALYZE;
+	} else {
+		self->al_state = AL_IDLE;
+		al_report(self, NULL);
+	}
+}
+
+static void
+al_response(BalanceControl *self, const MeterJobResponse* const r)
+{
+	switch (r->type) {
+		case AL_JOB_ALLOC:
+			if (r->al) {
+				self->al_cap   = r->al;
+				self->al_pos   = 0;
+				self->al_state = AL_CAPTURE;
+			} else {
+				self->al_state = AL_IDLE;
+				al_report(self, NULL);
+			}
+			break;
+		case AL_JOB_RUN:
+			self->al_state = AL_IDLE;
+			al_report(self, r->al_err ? NULL : &r->al_res);
+			break;
+	}
+}
+
+static int
+bd_schedule(BalanceControl *self, int type)
+{
+	MeterJob job = { type, NULL, 0, NULL, self->bd, self->bd_bpo };
+	if (self->schedule->schedule_work(self->schedule->handle, sizeof(job), &job) != LV2_WORKER_SUCCESS) {
+		return -1;
+	}
+	self->bd_pending = 1;
+	return 0;
+}
+
+/* cfg key 12: bands per octave, 0: off */
+static void
+bd_request(BalanceControl *self, const float val)
+{
+	self->bd_bpo = val >= 3 ? 3 : val >= 1 ? 1 : 0;
+	self->bd_new = 0;
+}
+
+/* queue the output, analyze once per meter update */
+static void
+bd_queue(BalanceControl *self, const uint32_t n_samples)
+{
+	if (!self->bd_bpo || !self->schedule) {
+		return;
+	}
+	BandAnalysis* const B = self->bd;
+	if (!B) {
+		if (!self->bd_pending) {
+			bd_schedule(self, BD_JOB_ALLOC);
+		}
+		return;
+	}
+	if (ar_write_space(&B->ring[0]) >= n_samples && ar_write_space(&B->ring[1]) >= n_samples) {
+		for (uint32_t c=0; c < 2; ++c) {
+			ar_put(&B->ring[c], 0, self->output[c], n_samples);
+			ar_commit(&B->ring[c], n_samples);
+		}
+		self->bd_queued += n_samples;
+	}
+	const uint32_t period = __atomic_load_n(&self->update_period, __ATOMIC_RELAXED);
+	if (!self->bd_pending && self->bd_queued >= period && bd_schedule(self, BD_JOB_RUN) == 0) {
+		self->bd_queued = 0;
+	}
+}
+
+static void
+bd_response(BalanceControl *self, const MeterJobResponse* const r)
+{
+	self->bd_pending = 0;
+	switch (r->type) {
+		case BD_JOB_ALLOC:
+			if (r->bd) {
+				self->bd = r->bd;
+				self->bd_queued = 0;
+			} else {
+				/* do not retry */
+				self->bd_bpo = 0;
+			}
+			break;
+		case BD_JOB_RUN:
+			if (r->bd_n > 0 && self->bd->bpo == self->bd_bpo) {
+				self->bd_resbpo = self->bd->bpo;
+				self->bd_first  = self->bd->first;
+				self->bd_n      = r->bd_n;
+				memcpy(self->bd_val, self->bd_wval, r->bd_n * sizeof(float));
+				self->bd_new = 1;
+			}
+			break;
+	}
+}
+
+/* cfg key 13 */
+static void
+scope_request(BalanceControl *self, const float val)
+{
+	const int mode = val >= 2 ? 2 : val >= 1 ? 1 : 0;
+	if (mode != self->scope_mode) {
+		self->scope_n = self->scope_acc = 0;
+		self->scope_ready = 0;
+	}
+	self->scope_mode = mode;
+}
+
+/* decimate the output to one point per `stride` samples, keep the
+ * latest SCOPE_POINTS to send */
+static void
+scope_run(BalanceControl *self, const uint32_t n_samples)
+{
+	const uint32_t period = __atomic_load_n(&self->update_period, __ATOMIC_RELAXED);
+	const uint32_t stride = MAX(1, period / SCOPE_POINTS);
+	float e[SCOPE_CHUNK];
+
+	if (self->scope_acc >= stride) {
+		/* the update rate changed, complete the point */
+		self->scope_acc = stride - 1;
+	}
+	self->scope_stride = stride;
+
+	for (uint32_t pos = 0; pos < n_samples;) {
+		const uint32_t n = MIN(MIN(stride - self->scope_acc, n_samples - pos), SCOPE_CHUNK);
+		const float* const L = &self->output[C_LEFT][pos];
+		const float* const R = &self->output[C_RIGHT][pos];
+		const float pk = self->mk.energy2(L, R, n, e, 0);
+		if (self->scope_acc == 0 || pk > self->scope_pk) {
+			uint32_t i = 0;
+			while (i < n - 1 && e[i] != pk) {
+				++i;
+			}
+			self->scope_pk = pk;
+			self->scope_pts[2 * self->scope_n]     = L[i];
+			self->scope_pts[2 * self->scope_n + 1] = R[i];
+		}
+		self->scope_acc += n;
+		pos += n;
+		if (self->scope_acc < stride) {
+			continue;
+		}
+		self->scope_acc = 0;
+		if (++self->scope_n == SCOPE_POINTS) {
+			memcpy(self->scope_out, self->scope_pts, sizeof(self->scope_out));
+			self->scope_n = 0;
+			self->scope_ready = 1;
+		}
+	}
+}
+
+/* one frame per cycle at most, after the meter frames of the cycle */
+static void
+scope_send(BalanceControl *self, const uint32_t n_samples)
+{
+	if (!self->scope_ready) {
+		return;
+	}
+	self->scope_ready = 0;
+	if (self->scope_mode == 2) {
+		for (uint32_t p=0; p < SCOPE_POINTS; ++p) {
+			const float l = self->scope_out[2 * p];
+			const float r = self->scope_out[2 * p + 1];
+			self->scope_out[2 * p]     = (l + r) * M_SQRT1_2;
+			self->scope_out[2 * p + 1] = (l - r) * M_SQRT1_2;
+		}
+	}
+	forge_scopeframe(&self->forge, &self->uris, n_samples - 1, self->scope_mode,
+			self->scope_stride, self->scope_out);
+}
+
+/* worker: the response of a job could not be delivered. Free what
+ * the job allocated and flag it for wk_recover() */
+static void
+work_lost(BalanceControl *self, const MeterJobResponse* const r)
+{
+	fprintf(stderr, "BLClv2 error: worker response lost\n");
+	switch (r->type) {
+		case MW_JOB_ALLOC:
+			mw_free(r->buf);
+			break;
+		case MW_JOB_METERS:
+			meter_release(self->mw_alloc.meters, self->mw_alloc.rms_in, self->mw_alloc.rms_out, self->mw_alloc.lufs);
+			break;
+		case AL_JOB_ALLOC:
+			al_free(r->al);
+			break;
+		case BD_JOB_ALLOC:
+			bands_free(r->bd);
+			break;
+	}
+	__atomic_fetch_or(&self->wk_lost, 1u << r->type, __ATOMIC_RELEASE);
+}
 
-		self->p_peak_outP[i] = self->p_peak_inP[i] = 0;
-		self->p_peak_outM[i] = self->p_peak_inM[i] = 0;
+/* audio thread: clear the state of jobs whose response was lost.
+ * Allocations are retried, analysis results are dropped */
+static void
+wk_recover(BalanceControl *self)
+{
+	const uint32_t lost = __atomic_exchange_n(&self->wk_lost, 0, __ATOMIC_ACQUIRE);
+	if (!lost) {
+		return;
+	}
+	for (int t = MW_JOB_ALLOC; t <= MW_JOB_METERS; ++t) {
+		if (lost & (1u << t)) {
+			--self->mw_pending;
+		}
+	}
+	if (lost & (1u << MW_JOB_ALLOC)) {
+		self->mw_state = MW_OFF;
+	}
+	if (lost & ((1u << AL_JOB_ALLOC) | (1u << AL_JOB_RUN))) {
+		self->al_state = AL_IDLE;
+		al_report(self, NULL);
+	}
+	if (lost & ((1u << BD_JOB_ALLOC) | (1u << BD_JOB_RUN))) {
+		self->bd_pending = 0;
 	}
-
-	memset(self->p_phase_outPi, 0, self->phase_integrate_max * sizeof(double));
-	memset(self->p_phase_outNi, 0, self->phase_integrate_max * sizeof(double));
-	self->peak_integrate_pos = self->phase_integrate_pos = 0;
-
-	self->p_peakcnt  = 0;
 }
 
-static void send_cfg_to_ui(BalanceControl* self) {
-	forge_kvcontrolmessage(&self->forge, &self->uris, CFG_INTEGRATE, self->peak_integrate_pref / self->samplerate);
-	forge_kvcontrolmessage(&self->forge, &self->uris, CFG_FALLOFF, self->meter_falloff * (float) UPDATE_FREQ);
-	forge_kvcontrolmessage(&self->forge, &self->uris, CFG_HOLDTIME, self->peak_hold / (float) UPDATE_FREQ);
-}
+static LV2_Worker_Status
+work(LV2_Handle                  instance,
+     LV2_Worker_Respond_Function respond,
+     LV2_Worker_Respond_Handle   handle,
+     uint32_t                    size,
+     const void*                 data)
+{
+	BalanceControl* self = (BalanceControl*)instance;
+	if (size != sizeof(MeterJob)) {
+		return LV2_WORKER_ERR_UNKNOWN;
+	}
+	const MeterJob* job = (const MeterJob*)data;
 
-static void update_meter_cfg(BalanceControl* self, int key, float val) {
-	switch (key) {
-		case 0:
-			if (val >=0 && val <= self->peak_integrate_max) {
-				self->peak_integrate_pref = val * self->samplerate;
+	MeterJobResponse r;
+	memset(&r, 0, sizeof(r));
+	r.type = job->type;
+
+	switch (job->type) {
+		case MW_JOB_ALLOC:
+			if (!(r.buf = mw_alloc(self))) {
+				fprintf(stderr, "BLClv2 error: metering worker: out of memory\n");
 			}
-			reset_uicom(self);
 			break;
-		case 1:
-				self->meter_falloff = MAX(0, val / UPDATE_FREQ);
-				self->meter_falloff = MIN(self->meter_falloff, 1000);
+		case MW_JOB_RUN:
+			{
+				const FPUState fpu = fpu_flush_denormals();
+				r.buf = job->buf;
+				memset(&r.buf->out, 0, sizeof(MeterMsgs));
+				self->mw_out = &r.buf->out;
+				mw_run(self, job->buf);
+				self->mw_out = NULL;
+				fpu_restore(fpu);
+			}
 			break;
-		case 2:
-				self->peak_hold = MAX(0, val * UPDATE_FREQ);
-				self->peak_hold = MIN(self->peak_hold, 60 * UPDATE_FREQ);
+		case MW_JOB_FREE:
+			mw_free(job->buf);
 			break;
-		case 3:
-			for (int i=0; i < CHANNELS; ++i) {
-				if ( ((int)val)&1) {
-					self->p_max_in[i] = -INFINITY;
-				}
-				if ( ((int)val)&2) {
-					self->p_max_out[i] = -INFINITY;
+		case MW_JOB_METERS:
+			{
+				MeterAlloc* const a = &self->mw_alloc;
+				memset(a, 0, sizeof(MeterAlloc));
+				a->meters = meter_alloc(self, job->meters, a->rms_in, a->rms_out, &a->lufs);
+				a->failed = job->meters & ~a->meters;
+			}
+			break;
+		case AL_JOB_ALLOC:
+			if (!(r.al = al_alloc(self))) {
+				fprintf(stderr, "BLClv2 error: alignment analysis: out of memory\n");
+			}
+			break;
+		case AL_JOB_RUN:
+			/* the UI applies the result to the [ms] ports only */
+			r.al_err = align_analyze(job->al->buf[C_LEFT], job->al->buf[C_RIGHT],
+					job->al->len, floor(MAXDELAY_MS * self->samplerate / 1000.0), &r.al_res);
+			break;
+		case BD_JOB_ALLOC:
+			if (!(r.bd = bands_alloc(self->samplerate, MW_RING_TIME * self->samplerate))) {
+				fprintf(stderr, "BLClv2 error: multiband correlation: out of memory\n");
+			}
+			break;
+		case BD_JOB_RUN:
+			{
+				BandAnalysis* const B = job->bd;
+				const FPUState fpu = fpu_flush_denormals();
+				if (B->bpo != job->bpo) {
+					bands_setup(B, job->bpo);
 				}
+				const uint32_t phase_window = __atomic_load_n(&self->phase_integrate_pref, __ATOMIC_RELAXED);
+				r.bd_n = bands_run(B, phase_window, self->bd_wval);
+				fpu_restore(fpu);
 			}
-			forge_kvcontrolmessage(&self->forge, &self->uris, PEAK_IN_LEFT, self->p_max_in[C_LEFT]);
-			forge_kvcontrolmessage(&self->forge, &self->uris, PEAK_IN_RIGHT, self->p_max_in[C_RIGHT]);
-			forge_kvcontrolmessage(&self->forge, &self->uris, PEAK_OUT_LEFT, self->p_max_out[C_LEFT]);
-			forge_kvcontrolmessage(&self->forge, &self->uris, PEAK_OUT_RIGHT, self->p_max_out[C_RIGHT]);
 			break;
+	}
+	/* the audio thread may take over the meters once it has the response */
+	if (respond(handle, sizeof(r), &r) != LV2_WORKER_SUCCESS) {
+		work_lost(self, &r);
+		return LV2_WORKER_ERR_NO_SPACE;
+	}
+	return LV2_WORKER_SUCCESS;
+}
 
-		default:
+static LV2_Worker_Status
+work_response(LV2_Handle  instance,
+              uint32_t    size,
+              const void* data)
+{
+	BalanceControl* self = (BalanceControl*)instance;
+	if (size != sizeof(MeterJobResponse)) {
+		return LV2_WORKER_ERR_UNKNOWN;
+	}
+	const MeterJobResponse* r = (const MeterJobResponse*)data;
+	if (r->type == AL_JOB_ALLOC || r->type == AL_JOB_RUN) {
+		al_response(self, r);
+		return LV2_WORKER_SUCCESS;
+	}
+	if (r->type == BD_JOB_ALLOC || r->type == BD_JOB_RUN) {
+		bd_response(self, r);
+		return LV2_WORKER_SUCCESS;
+	}
+	--self->mw_pending;
+
+	switch (r->type) {
+		case MW_JOB_ALLOC:
+			if (r->buf) {
+				self->mw_buf    = r->buf;
+				self->mw_state  = MW_ON;
+				self->mw_queued = 0;
+				self->mw_ctl    = 0;
+			} else {
+				self->mw_want  = 0;
+				self->mw_state = MW_OFF;
+			}
+			break;
+		case MW_JOB_RUN:
+			{
+				const MeterMsgs* const m = &r->buf->out;
+				for (int k = 0; k < MTR_FRAME_KEYS; ++k) {
+					if (m->mask & (1u << k)) {
+						self->msgs.val[k] = m->val[k];
+					}
+				}
+				self->msgs.mask |= m->mask;
+			}
+			break;
+		case MW_JOB_METERS:
+			{
+				/* no worker-mode change while a job is pending,
+				 * the audio thread owns the meters */
+				const MeterAlloc* const a = &self->mw_alloc;
+				for (int i=0; i < CHANNELS; ++i) {
+					if (a->meters & MTR_LEVEL_IN) {
+						self->rms_in[i] = a->rms_in[i];
+					}
+					if (a->meters & MTR_LEVEL_OUT) {
+						self->rms_out[i] = a->rms_out[i];
+					}
+				}
+				if (a->meters & MTR_LOUDNESS) {
+					self->lufs = a->lufs;
+				}
+				self->meters_mem |= a->meters;
+				/* do not retry meters that failed */
+				self->meters_req  &= ~a->failed;
+				self->meters_want &= ~a->failed;
+				meters_update(self);
+			}
 			break;
 	}
+	return LV2_WORKER_SUCCESS;
 }
 
 static void
-run(LV2_Handle instance, uint32_t n_samples)
+process(LV2_Handle instance, uint32_t n_samples)
 {
-	uint32_t i,c;
+	uint32_t c;
 	BalanceControl* self = (BalanceControl*)instance;
 	const float balance = *self->balance;
 	const float trim = db_to_gain(*self->trim);
 	float gain_left  = 1.0;
 	float gain_right = 1.0;
 
-	const int ascnt = self->samplerate / UPDATE_FREQ;
-
   const uint32_t capacity = self->notify->atom.size;
   lv2_atom_forge_set_buffer(&self->forge, (uint8_t*)self->notify, capacity);
   lv2_atom_forge_sequence_head(&self->forge, &self->frame, 0);
@@ -382,20 +2502,9 @@ run(LV2_Handle instance, uint32_t n_samples)
   /* reset after state restore */
 	if (self->queue_stateswitch) {
 		self->queue_stateswitch = 0;
-		self->peak_integrate_pref = self->state[0] * self->samplerate;
-		self->meter_falloff = self->state[1] / UPDATE_FREQ;
-		self->peak_hold = self->state[2] * UPDATE_FREQ;
-
-		self->peak_integrate_pref = MAX(0, self->peak_integrate_pref);
-		self->peak_integrate_pref = MIN(self->peak_integrate_pref, self->peak_integrate_max);
-
-		self->meter_falloff = MAX(0, self->meter_falloff);
-		self->meter_falloff = MIN(self->meter_falloff, 1000);
-
-		self->peak_hold = MAX(0, self->peak_hold);
-		self->peak_hold = MIN(self->peak_hold, 60 * UPDATE_FREQ);
+		self->mw_want = self->state[4] > 0;
 		reset_uicom(self);
-		send_cfg_to_ui(self);
+		meter_ctl(self, MW_REC_STATE, 0, self->state, 4);
 	}
 
   /* Process incoming events from GUI */
@@ -405,9 +2514,14 @@ run(LV2_Handle instance, uint32_t n_samples)
       if (ev->body.type == self->uris.atom_Blank || ev->body.type == self->uris.atom_Object) {
 				const LV2_Atom_Object* obj = (LV2_Atom_Object*)&ev->body;
 				if (obj->body.otype == self->uris.blc_meters_on) {
+					const LV2_Atom* value = NULL;
+					lv2_atom_object_get(obj, self->uris.blc_ccval, &value, 0);
+					meter_select(self, value ? ((LV2_Atom_Float*)value)->body : 0);
 					if (self->uicom_active == 0) {
 						reset_uicom(self);
-						send_cfg_to_ui(self);
+						meter_ctl(self, MW_REC_RESET, 0, NULL, 0);
+						/* the scope is streamed to the UI that requested it only */
+						scope_request(self, 0);
 						self->uicom_active = 1;
 					}
 				}
@@ -419,7 +2533,23 @@ run(LV2_Handle instance, uint32_t n_samples)
 					const LV2_Atom* value = NULL;
 					lv2_atom_object_get(obj, self->uris.blc_cckey, &key, self->uris.blc_ccval, &value, 0);
 					if (value && key) {
-						update_meter_cfg(self, ((LV2_Atom_Int*)key)->body, ((LV2_Atom_Float*)value)->body);
+						const int   k = ((LV2_Atom_Int*)key)->body;
+						const float v = ((LV2_Atom_Float*)value)->body;
+						if (k == 5) {
+							self->mw_want = v > 0;
+						} else if (k == 6) {
+							meter_select(self, v);
+						} else if (k == 8) {
+							self->deadband = MIN(MAX(0, v), 6);
+						} else if (k == 10) {
+							al_request(self, v);
+						} else if (k == 12) {
+							bd_request(self, v);
+						} else if (k == 13) {
+							scope_request(self, v);
+						} else if (k >= 0 && k < MW_CFG_KEYS) {
+							meter_ctl(self, MW_REC_CFG, k, &v, 1);
+						}
 					}
 				}
 			}
@@ -427,6 +2557,9 @@ run(LV2_Handle instance, uint32_t n_samples)
     }
 	}
 
+	wk_recover(self);
+	mw_update(self);
+
 	/* pre-calculate parameters */
 	if (balance < 0) {
 		gain_right = 1.0 + RAIL(balance, -1.0, 0.0);
@@ -462,204 +2595,276 @@ run(LV2_Handle instance, uint32_t n_samples)
 	if (*(self->phase[C_LEFT])) gain_left *=-1;
 	if (*(self->phase[C_RIGHT])) gain_right *=-1;
 
-	/* keep track of input levels -- only if GUI is visiable */
-	if (self->uicom_active) {
-		for (c=0; c < CHANNELS; ++c) {
-			for (i=0; i < n_samples; ++i) {
-				/* input peak meter */
-				const float ps = fabsf(self->input[c][i]);
-				if (ps > self->p_peak_in[c]) self->p_peak_in[c] = ps;
-
-				if (self->peak_integrate_pref < 1) {
-					const float psm = ps * ps;
-					if (psm > self->p_peak_inM[c]) self->p_peak_inM[c] = psm;
-					continue;
-				}
-
-				/* integrated level, peak */
-				const int pip = (self->peak_integrate_pos + i ) % self->peak_integrate_pref;
-				const double p_sig = SQUARE(self->input[c][i]);
-				self->p_peak_inP[c] += p_sig - self->p_peak_inPi[c][pip];
-				self->p_peak_inPi[c][pip] = p_sig;
-				/* peak of integrated signal */
-				const float psm = self->p_peak_inP[c] / (double) self->peak_integrate_pref;
-				if (psm > self->p_peak_inM[c]) self->p_peak_inM[c] = psm;
-			}
-		}
+	/* skip all processing if the input has been digitally silent for
+	 * longer than the delay ring (the ring holds only zeros) and the
+	 * meter windows on the delayed output have drained */
+	uint32_t silence = MIN(trailing_silence(self->input[C_LEFT], n_samples),
+			trailing_silence(self->input[C_RIGHT], n_samples));
+	uint32_t drain = 0;
+	if (self->uicom_active && (self->meters_want & (MTR_LEVEL_IN | MTR_LEVEL_OUT))) {
+		drain = __atomic_load_n(&self->peak_integrate_pref, __ATOMIC_RELAXED) + RMS_BLOCK;
 	}
-
-	/* process audio -- delayline + balance & gain */
-	if (self->input[0] == self->output[0]) {
-		/* possibly mono to stereo, left-channel is in-place
-		 * first process in (= left-out) -> right
-		 */
-		process_channel(self, gain_right * trim, C_RIGHT, n_samples);
-		process_channel(self, gain_left * trim,  C_LEFT, n_samples);
-	} else {
-		process_channel(self, gain_left * trim,  C_LEFT, n_samples);
-		process_channel(self, gain_right * trim, C_RIGHT, n_samples);
+	if (self->uicom_active && (self->meters_want & MTR_PHASE)) {
+		const uint32_t phase_window = __atomic_load_n(&self->phase_integrate_pref, __ATOMIC_RELAXED);
+		drain = MAX(drain, phase_window + phase_window / PHASE_SEGMENTS + 1);
+	}
+	const int idle = silence == n_samples
+		&& self->silence >= (uint32_t)self->dly.maxdelay + drain;
+	if (silence == n_samples) {
+		silence = MIN(self->silence + n_samples, (uint32_t)INT32_MAX);
 	}
+	self->silence = silence;
 
+	if (self->al_state == AL_CAPTURE) {
+		al_capture(self, n_samples);
+	}
 
-	/* swap/assign channels */
-	uint32_t pos = 0;
+	if (idle && self->uicom_active && mw_queueing(self)) {
+		if (mw_push(self, MW_REC_SILENCE, n_samples, NULL, 0, MW_CMD_RESERVE) == 0) {
+			self->mw_queued += n_samples;
+		}
+	}
 
-	if (self->c_monomode != (int) *self->monomode) {
-		/* smooth change */
-		const uint32_t fade_len = (n_samples >= FADE_LEN) ? FADE_LEN : n_samples;
-		for (; pos < fade_len; pos++) {
-			const float gain = (float)pos / (float)fade_len;
-			float x1[CHANNELS], x2[CHANNELS];
-			channel_map_change(self, self->c_monomode, pos, x1);
-			channel_map_change(self, (int) *self->monomode, pos, x2);
-			self->output[C_LEFT][pos] = x1[C_LEFT] * (1.0 - gain) + x2[C_LEFT] * gain;
-			self->output[C_RIGHT][pos] = x1[C_RIGHT] * (1.0 - gain) + x2[C_RIGHT] * gain;
+	/* keep track of input levels -- only if GUI is visiable */
+	if (self->uicom_active && !idle) {
+		if (mw_rt_meters(self)) {
+			rt_meter_input(self, n_samples);
+		} else if (mw_queueing(self)) {
+			/* before in-place processing overwrites it */
+			mw_queue_input(self, n_samples);
 		}
 	}
 
-	channel_map(self, (int) *self->monomode, pos, n_samples);
-	self->c_monomode = (int) *self->monomode;
+	/* process audio -- delayline + balance & gain */
+	int mode = (int) *self->monomode;
+	if (mode < 0 || mode > 4) {
+		mode = 0; // see channel_map()
+	}
 
-	/* audio processing done */
+	/* start transitions. Channel-map changes that arrive while a
+	 * cross-fade is in progress are picked up once it has completed.
+	 */
+	for (c=0; c < CHANNELS; ++c) {
+		strip_update(&self->dly, &self->strip[c], (c == C_LEFT ? gain_left : gain_right) * trim,
+				target_delay(&self->dly, self->delay_ms[c], self->delay[c]));
+	}
 
-	if (!self->uicom_active) {
-		return;
+	if (self->x_mono.len == 0 && self->c_monomode != mode) {
+		self->x_monomode = self->c_monomode;
+		self->c_monomode = mode;
+		self->x_mono.pos = 0;
+		self->x_mono.len = FADE_LEN;
 	}
 
-	/* output peak meter */
-	for (c=0; c < CHANNELS; ++c) {
-		for (i=0; i < n_samples; ++i) {
-			/* peak */
-			const float ps = fabsf(self->output[c][i]);
-			if (ps > self->p_peak_out[c]) self->p_peak_out[c] = ps;
+	/* report values to UI, before the meter frames of this cycle */
+	if (self->uicom_active) {
+		float bal = gain_to_db(fabsf(gain_left));
+		if (bal != self->p_bal[C_LEFT]) {
+			forge_kvcontrolmessage(&self->forge, &self->uris, GAIN_LEFT, bal);
+		}
+		self->p_bal[C_LEFT] = bal;
 
-				if (self->peak_integrate_pref < 1) {
-				const float psm = ps * ps;
-				if (psm > self->p_peak_outM[c]) self->p_peak_outM[c] = psm;
-				continue;
-			}
+		bal = gain_to_db(fabsf(gain_right));
+		if (bal != self->p_bal[C_RIGHT]) {
+			forge_kvcontrolmessage(&self->forge, &self->uris, GAIN_RIGHT, bal);
+		}
+		self->p_bal[C_RIGHT] = bal;
 
-			/* integrated level, peak */
-			const int pip = (self->peak_integrate_pos + i ) % self->peak_integrate_pref;
-			const double p_sig = SQUARE(self->output[c][i]);
-			self->p_peak_outP[c] += p_sig - self->p_peak_outPi[c][pip];
-			self->p_peak_outPi[c][pip] = p_sig;
-			/* peak of integrated signal */
-			const float psm = self->p_peak_outP[c] / (double) self->peak_integrate_pref;
-			if (psm > self->p_peak_outM[c]) self->p_peak_outM[c] = psm;
+		if (self->p_dly[C_LEFT] != self->strip[C_LEFT].c_dly) {
+			forge_kvcontrolmessage(&self->forge, &self->uris, DELAY_LEFT, (float) self->strip[C_LEFT].c_dly / self->samplerate);
 		}
-	}
-	if (self->peak_integrate_pref > 0) {
-		self->peak_integrate_pos = (self->peak_integrate_pos + n_samples ) % self->peak_integrate_pref;
+		self->p_dly[C_LEFT] = self->strip[C_LEFT].c_dly;
+
+		if (self->p_dly[C_RIGHT] != self->strip[C_RIGHT].c_dly) {
+			forge_kvcontrolmessage(&self->forge, &self->uris, DELAY_RIGHT, (float) self->strip[C_RIGHT].c_dly / self->samplerate);
+		}
+		self->p_dly[C_RIGHT] = self->strip[C_RIGHT].c_dly;
 	}
 
-	/* simple output phase correlation */
-	for (i=0; i < n_samples; ++i) {
-		const double p_pos = SQUARE(self->output[C_LEFT][i] + self->output[C_RIGHT][i]);
-		const double p_neg = SQUARE(self->output[C_LEFT][i] - self->output[C_RIGHT][i]);
+	/* including values received from the metering worker */
+	meter_send(self, 0);
 
-		/* integrate over 500ms */
-		self->p_phase_outP += p_pos - self->p_phase_outPi[self->phase_integrate_pos];
-		self->p_phase_outN += p_neg - self->p_phase_outNi[self->phase_integrate_pos];
-		self->p_phase_outPi[self->phase_integrate_pos] = p_pos;
-		self->p_phase_outNi[self->phase_integrate_pos] = p_neg;
-		self->phase_integrate_pos = (self->phase_integrate_pos + 1) % self->phase_integrate_max;
+	if (self->bd_new && self->uicom_active) {
+		forge_bandsframe(&self->forge, &self->uris, 0, self->bd_resbpo, self->bd_first, self->bd_n, self->bd_val);
 	}
+	self->bd_new = 0;
 
-/* abs peak hold */
-#define PKM(A,CHN,ID) \
-{ \
-	const float peak = VALTODB(self->p_peak_##A[CHN]); \
-	if (peak > self->p_max_##A[CHN]) { \
-		self->p_max_##A[CHN] = peak; \
-		self->p_tme_##A[CHN] = 0; \
-		forge_kvcontrolmessage(&self->forge, &self->uris, ID, self->p_max_##A[CHN]); \
-	} else if (self->peak_hold <= 0) { \
-		(self->p_tme_##A[CHN])=0; /* infinite hold */ \
-	} else if (self->p_tme_##A[CHN] <= self->peak_hold) { \
-		(self->p_tme_##A[CHN])++; \
-	} else if (self->meter_falloff == 0) { \
-		self->p_max_##A[CHN] = peak; \
-		forge_kvcontrolmessage(&self->forge, &self->uris, ID, self->p_max_##A[CHN]); \
-	} else { \
-		self->p_max_##A[CHN] -= self->meter_falloff; \
-		self->p_max_##A[CHN] = MAX(peak, self->p_max_##A[CHN]); \
-		forge_kvcontrolmessage(&self->forge, &self->uris, ID, self->p_max_##A[CHN]); \
-	} \
-}
+	if (idle) {
+		/* the delay ring holds only zeros: keep the pointers,
+		 * cross-fades between silent taps are silent */
+		for (c=0; c < CHANNELS; ++c) {
+			self->strip[c].x_dly.pos = self->strip[c].x_dly.len = 0;
+			memset(self->output[c], 0, n_samples * sizeof(float));
+		}
+		self->x_mono.pos = self->x_mono.len = 0;
 
-/* RMS meter */
-#define PKF(A,CHN,ID) \
-{ \
-	float dbp = VALTODB(sqrt(2.0 * self->p_peak_##A##M[CHN])); \
-	if (dbp > self->p_vpeak_##A[CHN]) { \
-		self->p_vpeak_##A[CHN] = dbp; \
-	} else if (self->meter_falloff == 0) { \
-		self->p_vpeak_##A[CHN] = dbp; \
-	} else { \
-		self->p_vpeak_##A[CHN] -= self->meter_falloff; \
-		self->p_vpeak_##A[CHN] = MAX(dbp, self->p_vpeak_##A[CHN]); \
-	} \
-	forge_kvcontrolmessage(&self->forge, &self->uris, ID, (self->p_vpeak_##A [CHN])); \
-}
+		if (self->uicom_active && mw_rt_meters(self)) {
+			rt_meter_output(self, n_samples, 1);
+		}
+	} else {
+		/* samples [0, split) are processed by the multi-pass reference
+		 * implementation, which handles delay and channel-map fades;
+		 * the rest by specialized fused kernels, gain ramps up to ramp_end.
+		 */
+		uint32_t ramp_end = 0;
+		for (c=0; c < CHANNELS; ++c) {
+			const GainRamp* const g = &self->strip[c].c_gain;
+			if (g->off < g->len) {
+				ramp_end = MAX(ramp_end, g->len - g->off);
+			}
+		}
+		ramp_end = MIN(ramp_end, n_samples);
 
-	/* report peaks to UI */
-	self->p_peakcnt += n_samples;
-	if (self->p_peakcnt > ascnt) {
+#ifdef BLC_MULTIPASS
+		const uint32_t split = n_samples;
+#else
+		uint32_t split = xfade_remain(&self->x_mono);
+		for (c=0; c < CHANNELS; ++c) {
+			split = MAX(split, xfade_remain(&self->strip[c].x_dly));
+		}
+		split = MIN(split, n_samples);
+#endif
 
-		PKF(in,  C_LEFT,  METER_IN_LEFT)
-		PKF(in,  C_RIGHT, METER_IN_RIGHT);
-		PKF(out, C_LEFT,  METER_OUT_LEFT);
-		PKF(out, C_RIGHT, METER_OUT_RIGHT);
+		if (split > 0) {
+			if (self->input[0] == self->output[0]) {
+				/* possibly mono to stereo, left-channel is in-place
+				 * first process in (= left-out) -> right
+				 */
+				process_channel(&self->dly, &self->strip[C_RIGHT], self->input[C_RIGHT], self->output[C_RIGHT], split);
+				process_channel(&self->dly, &self->strip[C_LEFT],  self->input[C_LEFT],  self->output[C_LEFT],  split);
+			} else {
+				process_channel(&self->dly, &self->strip[C_LEFT],  self->input[C_LEFT],  self->output[C_LEFT],  split);
+				process_channel(&self->dly, &self->strip[C_RIGHT], self->input[C_RIGHT], self->output[C_RIGHT], split);
+			}
 
-		PKM(in,  C_LEFT,  PEAK_IN_LEFT);
-		PKM(in,  C_RIGHT, PEAK_IN_RIGHT);
-		PKM(out, C_LEFT,  PEAK_OUT_LEFT);
-		PKM(out, C_RIGHT, PEAK_OUT_RIGHT);
+			/* swap/assign channels */
+			uint32_t pos = 0;
+
+			if (self->x_mono.len > 0) {
+				/* smooth change */
+				XFade* const x = &self->x_mono;
+				const uint32_t n = MIN(split, xfade_remain(x));
+				for (; pos < n; pos++) {
+					const float gain = (float)(x->pos + pos) / (float)x->len;
+					float x1[CHANNELS], x2[CHANNELS];
+					channel_map_change(self, self->x_monomode, pos, x1);
+					channel_map_change(self, self->c_monomode, pos, x2);
+					self->output[C_LEFT][pos] = x1[C_LEFT] * (1.0 - gain) + x2[C_LEFT] * gain;
+					self->output[C_RIGHT][pos] = x1[C_RIGHT] * (1.0 - gain) + x2[C_RIGHT] * gain;
+				}
+				x->pos += n;
+				if (x->pos >= x->len) {
+					x->len = x->pos = 0;
+				}
+			}
 
-#define RMSF(A) sqrt( ( (A) / (double)self->phase_integrate_max ) + 1.0e-12 )
-		double phase = 0.0;
-		const double phasdiv = self->p_phase_outP + self->p_phase_outN;
-		if (phasdiv >= 1.0e-6) {
-			phase = (RMSF(self->p_phase_outP) - RMSF(self->p_phase_outN)) / RMSF(phasdiv);
-		} else if (self->p_phase_outP > .001 && self->p_phase_outN > .001) {
-			phase = 1.0;
+			channel_map(self, self->c_monomode, pos, split);
 		}
 
-		forge_kvcontrolmessage(&self->forge, &self->uris, PHASE_OUT, phase);
+		/* output level: metered by the fused kernels as it is written,
+		 * or read back after (see MeterKernels.fuse_level) */
+		LevelAhead ahead = { self->p_peakcnt, 0 };
+		LevelAhead* const la = (self->uicom_active && mw_rt_meters(self)
+				&& (self->meters & MTR_LEVEL_OUT)) ? &ahead : NULL;
+		LevelAhead* const fused = self->mk.fuse_level ? la : NULL;
+		if (fused) {
+			rt_level_output(self, fused, 0, split);
+		}
 
-		self->p_peakcnt -= ascnt;
-		for (c=0; c < CHANNELS; ++c) {
-			self->p_peak_in[c] = -INFINITY;
-			self->p_peak_out[c] = -INFINITY;
-			self->p_peak_inM[c] = -INFINITY;
-			self->p_peak_outM[c] = -INFINITY;
+		if (split < ramp_end) {
+			process_fused(self, 1, split, ramp_end, fused);
+		}
+		if (MAX(split, ramp_end) < n_samples) {
+			process_fused(self, 0, MAX(split, ramp_end), n_samples, fused);
+		}
+
+		if (la && !fused) {
+			rt_level_output(self, la, 0, n_samples);
+		}
+		if (la) {
+			rt_level_end(self, la);
+		}
+		if (self->uicom_active && mw_rt_meters(self)) {
+			/* output true-peak, phase and loudness meters, while the output is in cache */
+			rt_meter_output(self, n_samples, 0);
+		} else if (self->uicom_active) {
+			mw_queue_output(self, n_samples);
 		}
 	}
 
-	/* report values to UI - if changed*/
-	float bal = gain_to_db(fabsf(gain_left));
-	if (bal != self->p_bal[C_LEFT]) {
-		forge_kvcontrolmessage(&self->forge, &self->uris, GAIN_LEFT, bal);
+	for (c=0; c < CHANNELS; ++c) {
+		strip_advance(&self->strip[c], n_samples);
 	}
-	self->p_bal[C_LEFT] = bal;
 
-	bal = gain_to_db(fabsf(gain_right));
-	if (bal != self->p_bal[C_RIGHT]) {
-		forge_kvcontrolmessage(&self->forge, &self->uris, GAIN_RIGHT, bal);
+	/* audio processing done */
+
+	if (self->uicom_active) {
+		bd_queue(self, n_samples);
+	}
+	if (self->uicom_active && self->scope_mode) {
+		scope_run(self, n_samples);
+		scope_send(self, n_samples);
 	}
-	self->p_bal[C_RIGHT] = bal;
 
-	if (self->p_dly[C_LEFT] != self->c_dly[C_LEFT]) {
-		forge_kvcontrolmessage(&self->forge, &self->uris, DELAY_LEFT, (float) self->c_dly[C_LEFT] / self->samplerate);
+	if (mw_queueing(self)) {
+		const uint32_t period = __atomic_load_n(&self->update_period, __ATOMIC_RELAXED);
+		if (self->mw_pending == 0
+				&& (self->mw_queued >= period / 2 || self->mw_ctl || self->mw_state == MW_STOPPING)
+				&& mw_schedule(self, MW_JOB_RUN, 0) == 0) {
+			self->mw_queued = 0;
+			self->mw_ctl = 0;
+		}
 	}
-	self->p_dly[C_LEFT] = self->c_dly[C_LEFT];
+}
+
+static void
+run(LV2_Handle instance, uint32_t n_samples)
+{
+	/* decaying ring and integrator values must not turn into
+	 * (slow) denormals */
+	const FPUState fpu = fpu_flush_denormals();
+	process(instance, n_samples);
+	fpu_restore(fpu);
+}
 
-	if (self->p_dly[C_RIGHT] != self->c_dly[C_RIGHT]) {
-		forge_kvcontrolmessage(&self->forge, &self->uris, DELAY_RIGHT, (float) self->c_dly[C_RIGHT] / self->samplerate);
+/* delay rings and gain smoothers of `nch` channels,
+ * for up to MAXDELAY_MS plus `spl` samples */
+static int
+dly_init(DelayCore *d, Strip *strip, const double rate, const uint32_t nch, const uint32_t spl)
+{
+	select_gain_kernels(&d->gk);
+	d->samplerate = rate;
+
+	/* max delay in samples at this rate, ring >= 2 * maxdelay */
+	d->maxdelay = ceil(MAXDELAY_MS * rate / 1000.0) + spl + 1;
+	int dlybufsize = 1;
+	while (dlybufsize < 2 * d->maxdelay) {
+		dlybufsize <<= 1;
+	}
+	d->dlymask = dlybufsize - 1;
+	d->dly_fade_len = MAX(FADE_LEN, rint(DLY_FADE_MS * rate / 1000.0));
+
+	for (uint32_t i=0; i < nch; ++i) {
+		if (!(strip[i].buffer = dly_alloc(dlybufsize))) {
+			fprintf(stderr, "BLClv2 error: out of memory\n");
+			for (uint32_t c=0; c < i; ++c) {
+				dly_free(strip[c].buffer);
+			}
+			return -1;
+		}
 	}
-	self->p_dly[C_RIGHT] = self->c_dly[C_RIGHT];
 
+	for (uint32_t i=0; i < nch; ++i) {
+		Strip* const s = &strip[i];
+		s->c_gain.amp = s->c_gain.target = 1.0;
+		s->c_gain.step = 0;
+		s->c_gain.len = s->c_gain.off = 0;
+		s->c_dly = 0;
+		s->x_dly.pos = s->x_dly.len = 0;
+		s->x_rptr = 0;
+		s->r_ptr = s->w_ptr = 0;
+	}
+	return 0;
 }
 
 static LV2_Handle
@@ -668,13 +2873,14 @@ instantiate(const LV2_Descriptor*     descriptor,
             const char*               bundle_path,
             const LV2_Feature* const* features)
 {
-	int i;
 	BalanceControl* self = (BalanceControl*) calloc(1, sizeof(BalanceControl));
 	if (!self) return NULL;
 
   for (int i=0; features[i]; ++i) {
     if (!strcmp(features[i]->URI, LV2_URID__map)) {
       self->map = (LV2_URID_Map*)features[i]->data;
+    } else if (!strcmp(features[i]->URI, LV2_WORKER__schedule)) {
+      self->schedule = (LV2_Worker_Schedule*)features[i]->data;
     }
   }
 
@@ -689,31 +2895,41 @@ instantiate(const LV2_Descriptor*     descriptor,
 
 	self->peak_integrate_max = PEAK_INTEGRATION_MAX * rate;
 	self->peak_integrate_pref = PEAK_INTEGRATION_TIME * rate;
-	self->phase_integrate_max = PHASE_INTEGRATION_TIME * rate;
-	self->meter_falloff = METER_FALLOFF / UPDATE_FREQ;
-	self->peak_hold = PEAK_HOLD_TIME * UPDATE_FREQ;
+	self->phase_integrate_pref = PHASE_INTEGRATION_TIME * rate;
+	self->meter_falloff_pref = METER_FALLOFF;
+	self->peak_hold_pref = PEAK_HOLD_TIME;
+	self->update_rate = UPDATE_FREQ;
 
 	assert(self->peak_integrate_max >= 0);
-	assert(self->phase_integrate_max > 0);
-	assert(self->peak_integrate_max <= self->phase_integrate_max);
+	assert(self->phase_integrate_pref > 0);
+	assert(PEAK_INTEGRATION_MAX <= PHASE_INTEGRATION_MIN);
 
-	for (i=0; i < CHANNELS; ++i) {
-		self->c_amp[i] = 1.0;
-		self->c_dly[i] = 0;
-		self->r_ptr[i] = self->w_ptr[i] = 0;
-		memset(self->buffer[i], 0, sizeof(float) * MAXDELAY);
-		self->p_peak_inPi[i]  = (double*) malloc(self->peak_integrate_max * sizeof(double));
-		self->p_peak_outPi[i] = (double*) malloc(self->peak_integrate_max * sizeof(double));
+	select_meter_kernels(&self->mk);
+
+	if (dly_init(&self->dly, self->strip, rate, CHANNELS, MAXDELAY_SPL)) {
+		free(self);
+		return NULL;
 	}
-	self->p_phase_outPi = (double*) malloc(self->phase_integrate_max * sizeof(double));
-	self->p_phase_outNi = (double*) malloc(self->phase_integrate_max * sizeof(double));
 
-	self->uicom_active = 0;
-	self->c_monomode = 0;
 	self->samplerate = rate;
+	meter_timing(self);
+
+	/* without a worker, meter memory cannot be allocated later */
+	self->meters_mem = MTR_NOALLOC;
+	if (!self->schedule) {
+		self->meters_mem = meter_alloc(self, MTR_MASK, self->rms_in, self->rms_out, &self->lufs);
+	}
+
+	self->uicom_active = 0;
+	self->silence = 0;
+	self->c_monomode = self->x_monomode = 0;
+	self->x_mono.pos = self->x_mono.len = 0;
 	self->queue_stateswitch = 0;
+	self->mw_state = MW_OFF;
+	self->al_state = AL_IDLE;
 
 	reset_uicom(self);
+	meter_reset(self, MTR_MASK);
 
 	return (LV2_Handle)self;
 }
@@ -750,6 +2966,12 @@ connect_port(LV2_Handle instance,
 	case BLC_DLYR:
 		self->delay[C_RIGHT] = (float*) data;
 		break;
+	case BLC_DLYLMS:
+		self->delay_ms[C_LEFT] = (float*) data;
+		break;
+	case BLC_DLYRMS:
+		self->delay_ms[C_RIGHT] = (float*) data;
+		break;
 	case BLC_INL:
 		self->input[C_LEFT] = (float*) data;
 		break;
@@ -784,8 +3006,10 @@ save(LV2_Handle                instance,
 	int  off = 0;
 
 	off += sprintf(cfg + off, "peak_integrate=%f\n", self->peak_integrate_pref / self->samplerate);
-	off += sprintf(cfg + off, "meter_falloff=%f\n", self->meter_falloff * (float) UPDATE_FREQ);
-	off += sprintf(cfg + off, "peak_hold=%f\n", self->peak_hold / (float) UPDATE_FREQ);
+	off += sprintf(cfg + off, "meter_falloff=%f\n", self->meter_falloff_pref);
+	off += sprintf(cfg + off, "peak_hold=%f\n", self->peak_hold_pref);
+	off += sprintf(cfg + off, "phase_integrate=%f\n", self->phase_integrate_pref / self->samplerate);
+	off += sprintf(cfg + off, "meter_worker=%d\n", self->mw_want);
 
 	store(handle, self->uris.blc_state,
 			cfg, strlen(cfg) + 1,
@@ -814,6 +3038,9 @@ restore(LV2_Handle                  instance,
 	const char* cfg = (const char*)value;
 	const char *te, *ts = cfg;
 
+	self->state[3] = PHASE_INTEGRATION_TIME; // not in older sessions
+	self->state[4] = 0;
+
 	while (ts && *ts && (te=strchr(ts, '\n'))) {
 		char *val;
 		char kv[1024];
@@ -827,6 +3054,10 @@ restore(LV2_Handle                  instance,
 				self->state[1] = atof(val+1);
 			} else if (!strcmp(kv, "peak_hold")) {
 				self->state[2] = atof(val+1);
+			} else if (!strcmp(kv, "phase_integrate")) {
+				self->state[3] = atof(val+1);
+			} else if (!strcmp(kv, "meter_worker")) {
+				self->state[4] = atof(val+1);
 			}
 		}
 		ts=te+1;
@@ -840,11 +3071,14 @@ cleanup(LV2_Handle instance)
 {
 	BalanceControl* self = (BalanceControl*)instance;
 	for (int i=0; i < CHANNELS; ++i) {
-		free(self->p_peak_inPi[i]);
-		free(self->p_peak_outPi[i]);
+		rms_free(&self->rms_in[i]);
+		rms_free(&self->rms_out[i]);
+		dly_free(self->strip[i].buffer);
 	}
-	free(self->p_phase_outPi);
-	free(self->p_phase_outNi);
+	mw_free(self->mw_buf);
+	al_free(self->al_cap);
+	bands_free(self->bd);
+	free(self->lufs);
 	free(instance);
 }
 
@@ -852,8 +3086,12 @@ const void*
 extension_data(const char* uri)
 {
   static const LV2_State_Interface  state  = { save, restore };
+  static const LV2_Worker_Interface worker = { work, work_response, NULL };
   if (!strcmp(uri, LV2_STATE__interface)) {
     return &state;
+  }
+  if (!strcmp(uri, LV2_WORKER__interface)) {
+    return &worker;
   }
 	return NULL;
 }
@@ -869,6 +3107,203 @@ static const LV2_Descriptor descriptor = {
 	extension_data
 };
 
+/* N-channel conditioners: trim, polarity and delay per channel,
+ * no balance, channel-map, meters or GUI.
+ * Ports: trim, phase[N], delay[N], in[N], out[N] */
+
+typedef struct {
+	float* phase;
+	float* delay_ms; // [ms]
+	float* input;
+	float* output;
+} ChannelPorts;
+
+typedef struct {
+	float*        trim;
+	DelayCore     dly;
+	ChannelPorts* port;  // [n_channels]
+	Strip*        strip; // [n_channels]
+	float*        copy;  // [n_channels * CHANNELS_CHUNK] see process_channels()
+	uint32_t      n_channels;
+	uint32_t      silence; // [samples] trailing digital silence of all inputs
+} Channels;
+
+/* the channel loops of a variant have a constant trip count */
+#if defined __clang__
+# define CHANNELS_UNROLL _Pragma("unroll")
+#elif defined __GNUC__ && __GNUC__ >= 8
+# define CHANNELS_UNROLL _Pragma("GCC unroll 16")
+#else
+# define CHANNELS_UNROLL
+#endif
+
+static void
+cleanup_channels(LV2_Handle instance)
+{
+	Channels* self = (Channels*)instance;
+	for (uint32_t i=0; i < self->n_channels && self->strip; ++i) {
+		dly_free(self->strip[i].buffer);
+	}
+	dly_free(self->copy);
+	free(self->strip);
+	free(self->port);
+	free(self);
+}
+
+static LV2_Handle
+instantiate_channels(const double rate, const uint32_t nch)
+{
+	Channels* self = (Channels*) calloc(1, sizeof(Channels));
+	if (!self) return NULL;
+
+	self->port  = (ChannelPorts*) calloc(nch, sizeof(ChannelPorts));
+	self->strip = (Strip*) calloc(nch, sizeof(Strip));
+	self->copy  = dly_alloc(nch * CHANNELS_CHUNK);
+	if (!self->port || !self->strip || !self->copy
+			|| dly_init(&self->dly, self->strip, rate, nch, 0)) {
+		cleanup_channels((LV2_Handle)self);
+		return NULL;
+	}
+	self->n_channels = nch;
+	return (LV2_Handle)self;
+}
+
+static void
+connect_port_channels(LV2_Handle instance,
+                      uint32_t   port,
+                      void*      data)
+{
+	Channels* self = (Channels*)instance;
+	const uint32_t nch = self->n_channels;
+
+	if (port == 0) {
+		self->trim = (float*) data;
+	} else if (port <= nch) {
+		self->port[port - 1].phase = (float*) data;
+	} else if (port <= 2 * nch) {
+		self->port[port - 1 - nch].delay_ms = (float*) data;
+	} else if (port <= 3 * nch) {
+		self->port[port - 1 - 2 * nch].input = (float*) data;
+	} else if (port <= 4 * nch) {
+		self->port[port - 1 - 3 * nch].output = (float*) data;
+	}
+}
+
+/* an output overlaps the input of a later channel, which
+ * processing the channels in order overwrites before it is read */
+static inline int
+channels_aliased(const ChannelPorts* const port, const uint32_t n, const uint32_t N)
+{
+	const uintptr_t sz = n * sizeof(float);
+	for (uint32_t c=0; c + 1 < N; ++c) {
+		const uintptr_t o = (uintptr_t)port[c].output;
+		for (uint32_t d=c + 1; d < N; ++d) {
+			const uintptr_t i = (uintptr_t)port[d].input;
+			if (i < o + sz && o < i + sz) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+/* Channels are independent: each one is delayed and amplified by the
+ * SIMD gain kernels, see process_channel(). Called with a constant N.
+ * If the host connects an output to the input of a later channel, the
+ * inputs are copied first, CHANNELS_CHUNK samples at a time. */
+static inline void
+process_channels(Channels *self, const uint32_t n_samples, const uint32_t N)
+{
+	const DelayCore* const d = &self->dly;
+	const ChannelPorts* const port = self->port;
+	Strip* const strip = self->strip;
+	const float trim = db_to_gain(*self->trim);
+
+	CHANNELS_UNROLL
+	for (uint32_t c=0; c < N; ++c) {
+		strip_update(d, &strip[c], *port[c].phase ? -trim : trim,
+				target_delay(d, port[c].delay_ms, NULL));
+	}
+
+	/* as in process(): skip the channels once all inputs have been
+	 * digitally silent for longer than the delay ring */
+	uint32_t silence = n_samples;
+	CHANNELS_UNROLL
+	for (uint32_t c=0; c < N; ++c) {
+		silence = MIN(silence, trailing_silence(port[c].input, n_samples));
+	}
+	const int idle = silence == n_samples
+		&& self->silence >= (uint32_t)d->maxdelay;
+	if (silence == n_samples) {
+		silence = MIN(self->silence + n_samples, (uint32_t)INT32_MAX);
+	}
+	self->silence = silence;
+
+	if (idle) {
+		CHANNELS_UNROLL
+		for (uint32_t c=0; c < N; ++c) {
+			strip[c].x_dly.pos = strip[c].x_dly.len = 0;
+			memset(port[c].output, 0, n_samples * sizeof(float));
+		}
+	} else if (!channels_aliased(port, n_samples, N)) {
+		CHANNELS_UNROLL
+		for (uint32_t c=0; c < N; ++c) {
+			process_channel(d, &strip[c], port[c].input, port[c].output, n_samples);
+		}
+	} else {
+		for (uint32_t pos = 0; pos < n_samples; pos += CHANNELS_CHUNK) {
+			const uint32_t len = MIN(n_samples - pos, CHANNELS_CHUNK);
+			CHANNELS_UNROLL
+			for (uint32_t c=0; c < N; ++c) {
+				memcpy(&self->copy[c * CHANNELS_CHUNK], &port[c].input[pos], len * sizeof(float));
+			}
+			CHANNELS_UNROLL
+			for (uint32_t c=0; c < N; ++c) {
+				process_channel(d, &strip[c], &self->copy[c * CHANNELS_CHUNK], &port[c].output[pos], len);
+				strip_advance(&strip[c], len);
+			}
+		}
+		return;
+	}
+
+	CHANNELS_UNROLL
+	for (uint32_t c=0; c < N; ++c) {
+		strip_advance(&strip[c], n_samples);
+	}
+}
+
+#define CHANNELS_VARIANT(N, URI) \
+static LV2_Handle \
+instantiate_##N(const LV2_Descriptor* descriptor, double rate, \
+		const char* bundle_path, const LV2_Feature* const* features) \
+{ \
+	(void)descriptor; (void)bundle_path; (void)features; \
+	return instantiate_channels(rate, N); \
+} \
+\
+static void \
+run_##N(LV2_Handle instance, uint32_t n_samples) \
+{ \
+	const FPUState fpu = fpu_flush_denormals(); \
+	process_channels((Channels*)instance, n_samples, N); \
+	fpu_restore(fpu); \
+} \
+\
+static const LV2_Descriptor descriptor_##N = { \
+	URI, \
+	instantiate_##N, \
+	connect_port_channels, \
+	NULL, \
+	run_##N, \
+	NULL, \
+	cleanup_channels, \
+	NULL \
+};
+
+CHANNELS_VARIANT(6,  BLC_URI_51)
+CHANNELS_VARIANT(8,  BLC_URI_71)
+CHANNELS_VARIANT(16, BLC_URI_16)
+
 #undef LV2_SYMBOL_EXPORT
 #ifdef _WIN32
 #    define LV2_SYMBOL_EXPORT __declspec(dllexport)
@@ -882,6 +3317,12 @@ lv2_descriptor(uint32_t index)
 	switch (index) {
 	case 0:
 		return &descriptor;
+	case 1:
+		return &descriptor_6;
+	case 2:
+		return &descriptor_8;
+	case 3:
+		return &descriptor_16;
 	default:
 		return NULL;
 	}
@@ -0,0 +1,286 @@
+/* balance -- LV2 stereo balance control
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Multiband phase correlation, not for realtime use. */
+
+#ifndef BLC_BANDS_H
+#define BLC_BANDS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "meters.h"
+#include "fft.h"
+
+/* The audio thread queues the output in two AnalysisRings. The worker
+ * runs it through a chain of halfband decimators: tier k holds the last
+ * BANDS_LEN samples at rate / 2^k. Every band is analyzed in the lowest
+ * rate tier that still covers it, so all FFTs are short and the low
+ * tiers, which need the long time span, are cheap to update.
+ * A tier is analyzed when a quarter of its window is new: Hann window,
+ * one FFT for both channels, bins grouped into octave or third-octave
+ * bands. Per band the cross-spectrum Re(L R*) and the power of both
+ * channels are averaged exponentially, with the time constant of the
+ * broadband phase meter.
+ * correlation = cross / sqrt(power L * power R).
+ *
+ * The lowest tier has ~3 Hz bins, so that the lowest third-octave bands
+ * get at least one bin. Bands that would be narrower use the next bin.
+ */
+
+#define BANDS_MAX   (32)
+#define BANDS_FMIN  (24.0)    // [Hz] lowest band center
+#define BANDS_FMAX  (20200.0) // [Hz] highest band center
+#define BANDS_RES   (3.0)     // [Hz] max. bin width
+#define BANDS_FLOOR (1e-10)   // ~ mean square of the signal in a band, below: silent
+#define BANDS_LEN   (1024)    // FFT size of every tier
+#define BANDS_TIERS (8)
+#define BANDS_CHUNK (256)     // [samples] read from the rings at a time
+
+/* 19 tap halfband lowpass, Kaiser window (beta 7): taps 1, 3, .. 9 off
+ * center, the center tap is 1/2. Passband 0 .. fs/8, > 70 dB rejection
+ * above 3fs/8, so after decimation 0 .. fs/4 of the new rate is free of
+ * aliases. Bands are only assigned to that range. */
+static const double bands_hb[5] = {
+	0.305842169, -0.073330113, 0.021558834, -0.004318101, 0.000209812
+};
+#define BANDS_HB_DELAY (9) // [samples] center tap
+
+typedef struct {
+	float*   hist[2];          // ring: the last BANDS_LEN samples
+	uint32_t hpos;             // oldest sample in `hist`
+	uint32_t fresh;            // samples since the last analysis
+	int      odd;              // decimator phase
+} BandTier;
+
+typedef struct {
+	AnalysisRing ring[2];      // audio thread -> worker
+	BandTier tier[BANDS_TIERS];
+	uint32_t ntiers;
+	float*   hmem;
+	double*  mem;
+	double  *re, *im, *wr, *wi, *win;
+	float    chunk[2][BANDS_CHUNK];
+	uint32_t bpo;              // bands per octave, 0: no bands yet
+	int      first;            // center of band b: 1 kHz * 2^((first + b) / bpo)
+	uint32_t n;                // bands
+	uint32_t tb[BANDS_MAX];    // tier of each band
+	uint32_t lo[BANDS_MAX], hi[BANDS_MAX]; // bins [lo, hi) of each band in its tier
+	double   cx[BANDS_MAX], pl[BANDS_MAX], pr[BANDS_MAX];
+	double   rate;
+} BandAnalysis;
+
+static void
+bands_free(BandAnalysis* B)
+{
+	if (!B) {
+		return;
+	}
+	free(B->ring[0].buf);
+	free(B->ring[1].buf);
+	free(B->hmem);
+	free(B->mem);
+	free(B);
+}
+
+/* `queue`: [samples] the audio thread may queue between analyses */
+static BandAnalysis*
+bands_alloc(const double rate, const uint32_t queue)
+{
+	BandAnalysis* B = (BandAnalysis*) calloc(1, sizeof(BandAnalysis));
+	if (!B) {
+		return NULL;
+	}
+	B->rate   = rate;
+	B->ntiers = 1;
+	while (B->ntiers < BANDS_TIERS && rate / (1 << (B->ntiers - 1)) / BANDS_LEN > BANDS_RES) {
+		++B->ntiers;
+	}
+	uint32_t size = 2;
+	while (size <= queue) {
+		size <<= 1;
+	}
+	for (int c = 0; c < 2; ++c) {
+		B->ring[c].size = size;
+		B->ring[c].buf  = (float*) malloc(size * sizeof(float));
+	}
+	B->hmem = (float*) calloc(2 * BANDS_LEN * B->ntiers, sizeof(float));
+	B->mem  = (double*) malloc(5 * BANDS_LEN * sizeof(double));
+	if (!B->ring[0].buf || !B->ring[1].buf || !B->hmem || !B->mem) {
+		bands_free(B);
+		return NULL;
+	}
+	for (uint32_t k = 0; k < B->ntiers; ++k) {
+		B->tier[k].hist[0] = &B->hmem[2 * k * BANDS_LEN];
+		B->tier[k].hist[1] = &B->hmem[(2 * k + 1) * BANDS_LEN];
+	}
+	B->re  = B->mem;
+	B->im  = &B->mem[BANDS_LEN];
+	B->wr  = &B->mem[2 * BANDS_LEN];
+	B->wi  = &B->mem[3 * BANDS_LEN];
+	B->win = &B->mem[4 * BANDS_LEN];
+	fft_init(B->wr, B->wi, B->win, BANDS_LEN);
+	return B;
+}
+
+/* band layout for `bpo` bands per octave (1 or 3), resets the averages */
+static void
+bands_setup(BandAnalysis* B, const uint32_t bpo)
+{
+	B->bpo   = bpo;
+	B->first = ceil(bpo * log2(BANDS_FMIN / 1000.0));
+	B->n     = 0;
+	for (int i = B->first; B->n < BANDS_MAX; ++i) {
+		const double fc = 1000.0 * pow(2.0, (double)i / bpo);
+		const double lo = 1000.0 * pow(2.0, (i - .5) / bpo);
+		const double hi = 1000.0 * pow(2.0, (i + .5) / bpo);
+		if (fc > BANDS_FMAX || hi >= B->rate / 2) {
+			break;
+		}
+		/* lowest rate whose alias-free range includes the band */
+		uint32_t k = B->ntiers - 1;
+		while (k > 0 && hi > B->rate / (1 << k) / 4) {
+			--k;
+		}
+		const double binw = B->rate / (1 << k) / BANDS_LEN;
+		B->tb[B->n] = k;
+		B->lo[B->n] = ceil(lo / binw);
+		B->hi[B->n] = ceil(hi / binw);
+		if (B->hi[B->n] <= B->lo[B->n]) {
+			B->hi[B->n] = B->lo[B->n] + 1;
+		}
+		++B->n;
+	}
+	memset(B->cx, 0, sizeof(B->cx));
+	memset(B->pl, 0, sizeof(B->pl));
+	memset(B->pr, 0, sizeof(B->pr));
+}
+
+/* halfband lowpass of the newest samples of `h`, delayed by BANDS_HB_DELAY */
+static inline float
+bands_decimate(const float* h, const uint32_t hpos)
+{
+	const uint32_t m = BANDS_LEN - 1;
+	const uint32_t c = hpos + BANDS_LEN - 1 - BANDS_HB_DELAY;
+	double y = .5 * h[c & m];
+	for (uint32_t j = 0; j < 5; ++j) {
+		y += bands_hb[j] * (h[(c - 2 * j - 1) & m] + h[(c + 2 * j + 1) & m]);
+	}
+	return y;
+}
+
+/* add one sample to tier `k` and, every other sample, to the tiers below */
+static void
+bands_push(BandAnalysis* B, uint32_t k, float l, float r)
+{
+	for (;;) {
+		BandTier* const T = &B->tier[k];
+		T->hist[0][T->hpos] = l;
+		T->hist[1][T->hpos] = r;
+		T->hpos = (T->hpos + 1) & (BANDS_LEN - 1);
+		++T->fresh;
+		if (++k >= B->ntiers || (T->odd ^= 1)) {
+			return;
+		}
+		l = bands_decimate(T->hist[0], T->hpos);
+		r = bands_decimate(T->hist[1], T->hpos);
+	}
+}
+
+/* consume the queued audio, analyze the tiers that have enough new data.
+ * `tau` [samples] time constant of the averages.
+ * Returns the number of bands written to `val` */
+static uint32_t
+bands_run(BandAnalysis* B, const double tau, float* val)
+{
+	const uint32_t len = BANDS_LEN;
+	uint32_t avail = ar_read_space(&B->ring[0]);
+	if (ar_read_space(&B->ring[1]) < avail) {
+		avail = ar_read_space(&B->ring[1]);
+	}
+	if (avail == 0 || B->n == 0) {
+		return 0;
+	}
+
+	for (uint32_t pos = 0; pos < avail;) {
+		const uint32_t n = avail - pos < BANDS_CHUNK ? avail - pos : BANDS_CHUNK;
+		for (int c = 0; c < 2; ++c) {
+			ar_get(&B->ring[c], 0, B->chunk[c], n);
+			ar_release(&B->ring[c], n);
+		}
+		for (uint32_t i = 0; i < n; ++i) {
+			bands_push(B, 0, B->chunk[0][i], B->chunk[1][i]);
+		}
+		pos += n;
+	}
+
+	/* Hann window: a band of mean square `ms` sums to 0.75 len^2 ms */
+	const double floor = BANDS_FLOOR * .75 * len * len;
+
+	for (uint32_t k = 0; k < B->ntiers; ++k) {
+		BandTier* const T = &B->tier[k];
+		if (T->fresh < len / 4) {
+			continue;
+		}
+		uint32_t b = 0;
+		while (b < B->n && B->tb[b] != k) {
+			++b;
+		}
+		if (b == B->n) {
+			T->fresh = 0;
+			continue;
+		}
+
+		for (uint32_t i = 0; i < len; ++i) {
+			const uint32_t h = (T->hpos + i) & (len - 1);
+			B->re[i] = T->hist[0][h] * B->win[i];
+			B->im[i] = T->hist[1][h] * B->win[i];
+		}
+		fft_run(B->re, B->im, B->wr, B->wi, len);
+
+		const double a = 1.0 - exp(-(double)T->fresh * (1 << k) / tau);
+		T->fresh = 0;
+
+		for (; b < B->n && B->tb[b] == k; ++b) {
+			double cx = 0, pl = 0, pr = 0;
+			for (uint32_t i = B->lo[b]; i < B->hi[b]; ++i) {
+				double lr, li, rr, ri;
+				fft_split(B->re, B->im, i, len, &lr, &li, &rr, &ri);
+				cx += lr * rr + li * ri;
+				pl += lr * lr + li * li;
+				pr += rr * rr + ri * ri;
+			}
+			B->cx[b] += a * (cx - B->cx[b]);
+			B->pl[b] += a * (pl - B->pl[b]);
+			B->pr[b] += a * (pr - B->pr[b]);
+		}
+	}
+
+	for (uint32_t b = 0; b < B->n; ++b) {
+		if (B->pl[b] > floor && B->pr[b] > floor) {
+			val[b] = B->cx[b] / sqrt(B->pl[b] * B->pr[b]);
+		} else {
+			val[b] = 0;
+		}
+	}
+	return B->n;
+}
+
+#endif
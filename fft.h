@@ -0,0 +1,86 @@
+/* balance -- LV2 stereo balance control
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Radix-2 FFT for the analysis in the worker thread. */
+
+#ifndef BLC_FFT_H
+#define BLC_FFT_H
+
+#include <stdint.h>
+#include <math.h>
+
+/* twiddles w[k] = exp(-2 pi i k / n) and Hann window, `n` values each */
+static void
+fft_init(double* wr, double* wi, double* win, const uint32_t n)
+{
+	for (uint32_t k = 0; k < n; ++k) {
+		wr[k]  = cos(2.0 * M_PI * k / n);
+		wi[k]  = -sin(2.0 * M_PI * k / n);
+		win[k] = .5 - .5 * cos(2.0 * M_PI * k / n);
+	}
+}
+
+/* in-place complex FFT, n power of two */
+static void
+fft_run(double* re, double* im, const double* wr, const double* wi, const uint32_t n)
+{
+	for (uint32_t i = 1, j = 0; i < n; ++i) {
+		uint32_t bit = n >> 1;
+		for (; j & bit; bit >>= 1) {
+			j ^= bit;
+		}
+		j ^= bit;
+		if (i < j) {
+			double t;
+			t = re[i]; re[i] = re[j]; re[j] = t;
+			t = im[i]; im[i] = im[j]; im[j] = t;
+		}
+	}
+	for (uint32_t len = 2; len <= n; len <<= 1) {
+		const uint32_t half = len >> 1;
+		const uint32_t step = n / len;
+		for (uint32_t i = 0; i < n; i += len) {
+			for (uint32_t k = 0; k < half; ++k) {
+				const uint32_t a = i + k;
+				const uint32_t b = a + half;
+				const double tr = re[b] * wr[k * step] - im[b] * wi[k * step];
+				const double ti = re[b] * wi[k * step] + im[b] * wr[k * step];
+				re[b] = re[a] - tr;
+				im[b] = im[a] - ti;
+				re[a] += tr;
+				im[a] += ti;
+			}
+		}
+	}
+}
+
+/* Two real signals are transformed at once as left + i right.
+ * Bin `k` of either spectrum, times two:
+ * L = Z[k] + Z*[n-k], R = (Z[k] - Z*[n-k]) / i */
+static inline void
+fft_split(const double* re, const double* im, const uint32_t k, const uint32_t n,
+		double* lr, double* li, double* rr, double* ri)
+{
+	const uint32_t m = (n - k) & (n - 1);
+	*lr = re[k] + re[m];
+	*li = im[k] - im[m];
+	*rr = im[k] + im[m];
+	*ri = re[m] - re[k];
+}
+
+#endif
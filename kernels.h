@@ -0,0 +1,826 @@
+/* balance -- LV2 stereo balance control
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* DSP kernels with runtime CPU dispatch.
+ *
+ * Every gain kernel evaluates the same expression per sample, in the
+ * same order, without fused multiply-add. All variants therefore
+ * produce bit-identical output. Sample indices are kept as floats;
+ * integers are exact in single precision up to 2^24.
+ *
+ * Meter kernels accumulate in lanes, the sums of each variant are
+ * rounded differently. This only affects the meter readout.
+ */
+
+#ifndef BLC_KERNELS_H
+#define BLC_KERNELS_H
+
+#include <stdint.h>
+#include <math.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+# define BLC_X86_DISPATCH
+# include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+# define BLC_NEON
+# include <arm_neon.h>
+#endif
+
+/* keep the compiler from fusing `a * b + c` into an FMA, which
+ * rounds differently (AVX-512F and NEON always provide FMA) */
+#if defined BLC_X86_DISPATCH
+# define NO_CONTRACT(x) __asm__("" : "+v" (x))
+#elif defined BLC_NEON && defined __GNUC__
+# define NO_CONTRACT(x) __asm__("" : "+w" (x))
+#else
+# define NO_CONTRACT(x)
+#endif
+
+typedef struct {
+	/* out[i] = in[i] * g */
+	void(*gain)       (float* out, const float* in, uint32_t n, float g);
+	/* out[i] = in[i] * (g0 + step * (off + i)) */
+	void(*ramp)       (float* out, const float* in, uint32_t n, float g0, float step, uint32_t off);
+	/* linear ramp while (off + i) < len, constant g1 afterwards */
+	void(*ramp_const) (float* out, const float* in, uint32_t n, float g0, float step, uint32_t off, uint32_t len, float g1);
+} GainKernels;
+
+#define RAMP_CONST_KERNEL(ISA, ATTR) \
+ATTR static void \
+gain_ramp_const_##ISA(float* out, const float* in, uint32_t n, \
+		float g0, float step, uint32_t off, uint32_t len, float g1) \
+{ \
+	const uint32_t nr = off >= len ? 0 : (len - off < n ? len - off : n); \
+	gain_ramp_##ISA(out, in, nr, g0, step, off); \
+	gain_const_##ISA(&out[nr], &in[nr], n - nr, g1); \
+}
+
+/* scalar reference */
+
+static void
+gain_const_c(float* out, const float* in, uint32_t n, float g)
+{
+	for (uint32_t i = 0; i < n; ++i) {
+		out[i] = in[i] * g;
+	}
+}
+
+static void
+gain_ramp_c(float* out, const float* in, uint32_t n, float g0, float step, uint32_t off)
+{
+	for (uint32_t i = 0; i < n; ++i) {
+		float d = step * (float)(off + i);
+		NO_CONTRACT(d);
+		out[i] = in[i] * (g0 + d);
+	}
+}
+
+RAMP_CONST_KERNEL(c, )
+
+#ifdef BLC_X86_DISPATCH
+
+/* SSE2 */
+
+__attribute__((target("sse2"))) static void
+gain_const_sse2(float* out, const float* in, uint32_t n, float g)
+{
+	uint32_t i = 0;
+	const __m128 vg = _mm_set1_ps(g);
+	for (; i + 4 <= n; i += 4) {
+		_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps(&in[i]), vg));
+	}
+	for (; i < n; ++i) {
+		out[i] = in[i] * g;
+	}
+}
+
+__attribute__((target("sse2"))) static void
+gain_ramp_sse2(float* out, const float* in, uint32_t n, float g0, float step, uint32_t off)
+{
+	uint32_t i = 0;
+	const __m128 v0 = _mm_set1_ps(g0);
+	const __m128 vs = _mm_set1_ps(step);
+	const __m128 v4 = _mm_set1_ps(4.f);
+	__m128 vi = _mm_add_ps(_mm_set1_ps((float)off), _mm_setr_ps(0, 1, 2, 3));
+	for (; i + 4 <= n; i += 4) {
+		__m128 d = _mm_mul_ps(vs, vi);
+		NO_CONTRACT(d);
+		const __m128 g = _mm_add_ps(v0, d);
+		_mm_storeu_ps(&out[i], _mm_mul_ps(_mm_loadu_ps(&in[i]), g));
+		vi = _mm_add_ps(vi, v4);
+	}
+	for (; i < n; ++i) {
+		float d = step * (float)(off + i);
+		NO_CONTRACT(d);
+		out[i] = in[i] * (g0 + d);
+	}
+}
+
+RAMP_CONST_KERNEL(sse2, __attribute__((target("sse2"))))
+
+/* AVX2 */
+
+__attribute__((target("avx2"))) static void
+gain_const_avx2(float* out, const float* in, uint32_t n, float g)
+{
+	uint32_t i = 0;
+	const __m256 vg = _mm256_set1_ps(g);
+	for (; i + 8 <= n; i += 8) {
+		_mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_loadu_ps(&in[i]), vg));
+	}
+	for (; i < n; ++i) {
+		out[i] = in[i] * g;
+	}
+}
+
+__attribute__((target("avx2"))) static void
+gain_ramp_avx2(float* out, const float* in, uint32_t n, float g0, float step, uint32_t off)
+{
+	uint32_t i = 0;
+	const __m256 v0 = _mm256_set1_ps(g0);
+	const __m256 vs = _mm256_set1_ps(step);
+	const __m256 v8 = _mm256_set1_ps(8.f);
+	__m256 vi = _mm256_add_ps(_mm256_set1_ps((float)off), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7));
+	for (; i + 8 <= n; i += 8) {
+		__m256 d = _mm256_mul_ps(vs, vi);
+		NO_CONTRACT(d);
+		const __m256 g = _mm256_add_ps(v0, d);
+		_mm256_storeu_ps(&out[i], _mm256_mul_ps(_mm256_loadu_ps(&in[i]), g));
+		vi = _mm256_add_ps(vi, v8);
+	}
+	for (; i < n; ++i) {
+		float d = step * (float)(off + i);
+		NO_CONTRACT(d);
+		out[i] = in[i] * (g0 + d);
+	}
+}
+
+RAMP_CONST_KERNEL(avx2, __attribute__((target("avx2"))))
+
+/* AVX-512 */
+
+__attribute__((target("avx512f"))) static void
+gain_const_avx512(float* out, const float* in, uint32_t n, float g)
+{
+	uint32_t i = 0;
+	const __m512 vg = _mm512_set1_ps(g);
+	for (; i + 16 <= n; i += 16) {
+		_mm512_storeu_ps(&out[i], _mm512_mul_ps(_mm512_loadu_ps(&in[i]), vg));
+	}
+	if (i < n) {
+		const __mmask16 m = (__mmask16)((1u << (n - i)) - 1);
+		_mm512_mask_storeu_ps(&out[i], m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, &in[i]), vg));
+	}
+}
+
+__attribute__((target("avx512f"))) static void
+gain_ramp_avx512(float* out, const float* in, uint32_t n, float g0, float step, uint32_t off)
+{
+	uint32_t i = 0;
+	const __m512 v0  = _mm512_set1_ps(g0);
+	const __m512 vs  = _mm512_set1_ps(step);
+	const __m512 v16 = _mm512_set1_ps(16.f);
+	__m512 vi = _mm512_add_ps(_mm512_set1_ps((float)off),
+			_mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+	for (; i < n; i += 16) {
+		const __mmask16 m = (n - i) >= 16 ? 0xffff : (__mmask16)((1u << (n - i)) - 1);
+		__m512 d = _mm512_mul_ps(vs, vi);
+		NO_CONTRACT(d);
+		const __m512 g = _mm512_add_ps(v0, d);
+		_mm512_mask_storeu_ps(&out[i], m, _mm512_mul_ps(_mm512_maskz_loadu_ps(m, &in[i]), g));
+		vi = _mm512_add_ps(vi, v16);
+	}
+}
+
+RAMP_CONST_KERNEL(avx512, __attribute__((target("avx512f"))))
+
+#endif /* BLC_X86_DISPATCH */
+
+#ifdef BLC_NEON
+
+static void
+gain_const_neon(float* out, const float* in, uint32_t n, float g)
+{
+	uint32_t i = 0;
+	const float32x4_t vg = vdupq_n_f32(g);
+	for (; i + 4 <= n; i += 4) {
+		vst1q_f32(&out[i], vmulq_f32(vld1q_f32(&in[i]), vg));
+	}
+	for (; i < n; ++i) {
+		out[i] = in[i] * g;
+	}
+}
+
+static void
+gain_ramp_neon(float* out, const float* in, uint32_t n, float g0, float step, uint32_t off)
+{
+	uint32_t i = 0;
+	static const float idx[4] = { 0, 1, 2, 3 };
+	const float32x4_t v0 = vdupq_n_f32(g0);
+	const float32x4_t vs = vdupq_n_f32(step);
+	const float32x4_t v4 = vdupq_n_f32(4.f);
+	float32x4_t vi = vaddq_f32(vdupq_n_f32((float)off), vld1q_f32(idx));
+	for (; i + 4 <= n; i += 4) {
+		float32x4_t d = vmulq_f32(vs, vi);
+		NO_CONTRACT(d);
+		const float32x4_t g = vaddq_f32(v0, d);
+		vst1q_f32(&out[i], vmulq_f32(vld1q_f32(&in[i]), g));
+		vi = vaddq_f32(vi, v4);
+	}
+	for (; i < n; ++i) {
+		float d = step * (float)(off + i);
+		NO_CONTRACT(d);
+		out[i] = in[i] * (g0 + d);
+	}
+}
+
+RAMP_CONST_KERNEL(neon, )
+
+#endif /* BLC_NEON */
+
+/* Meter kernels.
+ * Peak detection skips NaN, like the scalar `if (a > pk) pk = a`
+ * (x86 max returns its second operand if either one is NaN).
+ */
+
+typedef struct {
+	/* max (pk, |in[i]|) */
+	float(*peak)   (const float* in, uint32_t n, float pk);
+	/* sum of in[i]^2 */
+	float(*sumsq)  (const float* in, uint32_t n);
+	/* sum of (a[i] + b[i])^2 and of (a[i] - b[i])^2 */
+	void  (*sumsq2) (const float* a, const float* b, uint32_t n, float* sp, float* sn);
+	/* e[i] = a[i]^2 + b[i]^2, returns max (pk, e[i]) */
+	float(*energy2) (const float* a, const float* b, uint32_t n, float* e, float pk);
+	/* for `nblk` consecutive blocks of 16 samples: sum of squares of
+	 * each block, and of its samples [tpos, 16) */
+	void  (*sumsq16) (const float* in, uint32_t nblk, uint32_t tpos, float* blk, float* tail);
+	/* max (pk, |y|) of the 4x oversampled signal, see tp_coeff.
+	 * Reads in[-TP_TAPS + 1] .. in[n - 1] */
+	float(*tpeak)  (const float* in, uint32_t n, float pk);
+	/* K-weighting of a stereo pair, two biquads per channel in double
+	 * precision. Returns the sum of squares of both filtered channels.
+	 * `c`: b0 b1 b2 a1 a2 of each stage, `z`: [stage][z1, z2][L, R] */
+	double(*kweight) (const float* l, const float* r, uint32_t n, const double* c, double* z);
+	/* 1: the fused kernels meter the output level as they write it
+	 * (balance.c). 0: reading it back with these kernels is cheaper */
+	int fuse_level;
+} MeterKernels;
+
+/* true-peak interpolator, ITU-R BS.1770-4 Annex 2: 48-tap FIR,
+ * 4 phases of 12 taps. out[4 * i + p] = sum_k tp_coeff[p][k] * in[i - k] */
+#define TP_PHASES (4)
+#define TP_TAPS  (12)
+
+static const float tp_coeff[TP_PHASES][TP_TAPS] = {
+	{  0.0017089843750f,  0.0109863281250f, -0.0196533203125f,  0.0332031250000f,
+	  -0.0594482421875f,  0.1373291015625f,  0.9721679687500f, -0.1022949218750f,
+	   0.0476074218750f, -0.0266113281250f,  0.0148925781250f, -0.0083007812500f },
+	{ -0.0291748046875f,  0.0292968750000f, -0.0517578125000f,  0.0891113281250f,
+	  -0.1665039062500f,  0.4650878906250f,  0.7797851562500f, -0.2003173828125f,
+	   0.1015625000000f, -0.0582275390625f,  0.0330810546875f, -0.0189208984375f },
+	{ -0.0189208984375f,  0.0330810546875f, -0.0582275390625f,  0.1015625000000f,
+	  -0.2003173828125f,  0.7797851562500f,  0.4650878906250f, -0.1665039062500f,
+	   0.0891113281250f, -0.0517578125000f,  0.0292968750000f, -0.0291748046875f },
+	{ -0.0083007812500f,  0.0148925781250f, -0.0266113281250f,  0.0476074218750f,
+	  -0.1022949218750f,  0.9721679687500f,  0.1373291015625f, -0.0594482421875f,
+	   0.0332031250000f, -0.0196533203125f,  0.0109863281250f,  0.0017089843750f },
+};
+
+#define LANE_MASK_16(M, TPOS) \
+	int32_t M[16]; \
+	for (uint32_t k = 0; k < 16; ++k) { M[k] = k >= (TPOS) ? -1 : 0; }
+
+/* scalar reference */
+
+static float
+meter_peak_c(const float* in, uint32_t n, float pk)
+{
+	for (uint32_t i = 0; i < n; ++i) {
+		const float a = fabsf(in[i]);
+		if (a > pk) pk = a;
+	}
+	return pk;
+}
+
+static float
+meter_sumsq_c(const float* in, uint32_t n)
+{
+	float s = 0;
+	for (uint32_t i = 0; i < n; ++i) {
+		s += in[i] * in[i];
+	}
+	return s;
+}
+
+static void
+meter_sumsq2_c(const float* a, const float* b, uint32_t n, float* sp, float* sn)
+{
+	float p = 0, m = 0;
+	for (uint32_t i = 0; i < n; ++i) {
+		const float s = a[i] + b[i];
+		const float d = a[i] - b[i];
+		p += s * s;
+		m += d * d;
+	}
+	*sp = p;
+	*sn = m;
+}
+
+static float
+meter_energy2_c(const float* a, const float* b, uint32_t n, float* e, float pk)
+{
+	for (uint32_t i = 0; i < n; ++i) {
+		e[i] = a[i] * a[i] + b[i] * b[i];
+		if (e[i] > pk) pk = e[i];
+	}
+	return pk;
+}
+
+static void
+meter_sumsq16_c(const float* in, uint32_t nblk, uint32_t tpos, float* blk, float* tail)
+{
+	for (uint32_t b = 0; b < nblk; ++b, in += 16) {
+		float s = 0, t = 0;
+		for (uint32_t k = 0; k < tpos; ++k) {
+			s += in[k] * in[k];
+		}
+		for (uint32_t k = tpos; k < 16; ++k) {
+			t += in[k] * in[k];
+		}
+		blk[b]  = s + t;
+		tail[b] = t;
+	}
+}
+
+/* transposed direct form II */
+static double
+meter_kweight_c(const float* l, const float* r, uint32_t n, const double* c, double* z)
+{
+	double sl = 0, sr = 0;
+	for (uint32_t i = 0; i < n; ++i) {
+		double x[2] = { l[i], r[i] };
+		for (int s = 0; s < 2; ++s) {
+			const double* b = &c[5 * s];
+			double* zs = &z[4 * s];
+			for (int ch = 0; ch < 2; ++ch) {
+				const double y = b[0] * x[ch] + zs[ch];
+				zs[ch]     = (b[1] * x[ch] - b[3] * y) + zs[2 + ch];
+				zs[2 + ch] = b[2] * x[ch] - b[4] * y;
+				x[ch] = y;
+			}
+		}
+		sl += x[0] * x[0];
+		sr += x[1] * x[1];
+	}
+	return sl + sr;
+}
+
+static float
+meter_tpeak_c(const float* in, uint32_t n, float pk)
+{
+	for (uint32_t i = 0; i < n; ++i) {
+		for (int p = 0; p < TP_PHASES; ++p) {
+			float y = 0;
+			for (int k = 0; k < TP_TAPS; ++k) {
+				y += tp_coeff[p][k] * in[(int)i - k];
+			}
+			const float a = fabsf(y);
+			if (a > pk) pk = a;
+		}
+	}
+	return pk;
+}
+
+#ifdef BLC_X86_DISPATCH
+
+/* SSE2 */
+
+__attribute__((target("sse2"))) static inline float
+hmax_sse2(__m128 v)
+{
+	v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_max_ps(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse2"))) static inline float
+hsum_sse2(__m128 v)
+{
+	v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+	v = _mm_add_ss(v, _mm_shuffle_ps(v, v, 1));
+	return _mm_cvtss_f32(v);
+}
+
+__attribute__((target("sse2"))) static float
+meter_peak_sse2(const float* in, uint32_t n, float pk)
+{
+	uint32_t i = 0;
+	const __m128 vabs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 vm = _mm_set1_ps(pk);
+	__m128 v1 = vm;
+	for (; i + 8 <= n; i += 8) {
+		vm = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(&in[i]), vabs), vm);
+		v1 = _mm_max_ps(_mm_and_ps(_mm_loadu_ps(&in[i + 4]), vabs), v1);
+	}
+	vm = _mm_max_ps(vm, v1);
+	return meter_peak_c(&in[i], n - i, hmax_sse2(vm));
+}
+
+__attribute__((target("sse2"))) static float
+meter_sumsq_sse2(const float* in, uint32_t n)
+{
+	uint32_t i = 0;
+	__m128 vs = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4) {
+		const __m128 x = _mm_loadu_ps(&in[i]);
+		vs = _mm_add_ps(vs, _mm_mul_ps(x, x));
+	}
+	return hsum_sse2(vs) + meter_sumsq_c(&in[i], n - i);
+}
+
+__attribute__((target("sse2"))) static void
+meter_sumsq2_sse2(const float* a, const float* b, uint32_t n, float* sp, float* sn)
+{
+	uint32_t i = 0;
+	__m128 vp = _mm_setzero_ps();
+	__m128 vn = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4) {
+		const __m128 va = _mm_loadu_ps(&a[i]);
+		const __m128 vb = _mm_loadu_ps(&b[i]);
+		const __m128 s  = _mm_add_ps(va, vb);
+		const __m128 d  = _mm_sub_ps(va, vb);
+		vp = _mm_add_ps(vp, _mm_mul_ps(s, s));
+		vn = _mm_add_ps(vn, _mm_mul_ps(d, d));
+	}
+	meter_sumsq2_c(&a[i], &b[i], n - i, sp, sn);
+	*sp += hsum_sse2(vp);
+	*sn += hsum_sse2(vn);
+}
+
+__attribute__((target("sse2"))) static float
+meter_energy2_sse2(const float* a, const float* b, uint32_t n, float* e, float pk)
+{
+	uint32_t i = 0;
+	__m128 vm = _mm_set1_ps(pk);
+	for (; i + 4 <= n; i += 4) {
+		const __m128 va = _mm_loadu_ps(&a[i]);
+		const __m128 vb = _mm_loadu_ps(&b[i]);
+		const __m128 ve = _mm_add_ps(_mm_mul_ps(va, va), _mm_mul_ps(vb, vb));
+		_mm_storeu_ps(&e[i], ve);
+		vm = _mm_max_ps(ve, vm);
+	}
+	return meter_energy2_c(&a[i], &b[i], n - i, &e[i], hmax_sse2(vm));
+}
+
+/* lanes of 4 blocks: return [sum(v0), sum(v1), sum(v2), sum(v3)] */
+__attribute__((target("sse2"))) static inline __m128
+hsum4_sse2(__m128 v0, __m128 v1, __m128 v2, __m128 v3)
+{
+	_MM_TRANSPOSE4_PS(v0, v1, v2, v3);
+	return _mm_add_ps(_mm_add_ps(v0, v1), _mm_add_ps(v2, v3));
+}
+
+/* squares of 16 samples: whole block and masked tail, 4 lanes each */
+#define SUMSQ16_SSE2(X, S, T) \
+	{ \
+		__m128 q[4]; \
+		for (int k = 0; k < 4; ++k) { \
+			const __m128 x = _mm_loadu_ps(&(X)[4 * k]); \
+			q[k] = _mm_mul_ps(x, x); \
+		} \
+		S = _mm_add_ps(_mm_add_ps(q[0], q[1]), _mm_add_ps(q[2], q[3])); \
+		T = _mm_add_ps( \
+				_mm_add_ps(_mm_and_ps(q[0], m[0]), _mm_and_ps(q[1], m[1])), \
+				_mm_add_ps(_mm_and_ps(q[2], m[2]), _mm_and_ps(q[3], m[3]))); \
+	}
+
+__attribute__((target("sse2"))) static void
+meter_sumsq16_sse2(const float* in, uint32_t nblk, uint32_t tpos, float* blk, float* tail)
+{
+	uint32_t b = 0;
+	LANE_MASK_16(lm, tpos);
+	__m128 m[4];
+	for (int k = 0; k < 4; ++k) {
+		m[k] = _mm_castsi128_ps(_mm_loadu_si128((const __m128i*)&lm[4 * k]));
+	}
+	for (; b + 4 <= nblk; b += 4, in += 64) {
+		__m128 s[4], t[4];
+		for (int j = 0; j < 4; ++j) {
+			SUMSQ16_SSE2(&in[16 * j], s[j], t[j]);
+		}
+		_mm_storeu_ps(&blk[b],  hsum4_sse2(s[0], s[1], s[2], s[3]));
+		_mm_storeu_ps(&tail[b], hsum4_sse2(t[0], t[1], t[2], t[3]));
+	}
+	for (; b < nblk; ++b, in += 16) {
+		__m128 s, t;
+		SUMSQ16_SSE2(in, s, t);
+		blk[b]  = hsum_sse2(s);
+		tail[b] = hsum_sse2(t);
+	}
+}
+
+/* L and R in the two lanes */
+__attribute__((target("sse2"))) static double
+meter_kweight_sse2(const float* l, const float* r, uint32_t n, const double* c, double* z)
+{
+	__m128d b[2][5], z1[2], z2[2];
+	for (int s = 0; s < 2; ++s) {
+		for (int k = 0; k < 5; ++k) {
+			b[s][k] = _mm_set1_pd(c[5 * s + k]);
+		}
+		z1[s] = _mm_loadu_pd(&z[4 * s]);
+		z2[s] = _mm_loadu_pd(&z[4 * s + 2]);
+	}
+	__m128d acc = _mm_setzero_pd();
+	for (uint32_t i = 0; i < n; ++i) {
+		__m128d x = _mm_set_pd(r[i], l[i]);
+		for (int s = 0; s < 2; ++s) {
+			const __m128d y = _mm_add_pd(_mm_mul_pd(b[s][0], x), z1[s]);
+			z1[s] = _mm_add_pd(_mm_sub_pd(_mm_mul_pd(b[s][1], x), _mm_mul_pd(b[s][3], y)), z2[s]);
+			z2[s] = _mm_sub_pd(_mm_mul_pd(b[s][2], x), _mm_mul_pd(b[s][4], y));
+			x = y;
+		}
+		acc = _mm_add_pd(acc, _mm_mul_pd(x, x));
+	}
+	for (int s = 0; s < 2; ++s) {
+		_mm_storeu_pd(&z[4 * s], z1[s]);
+		_mm_storeu_pd(&z[4 * s + 2], z2[s]);
+	}
+	double t[2];
+	_mm_storeu_pd(t, acc);
+	return t[0] + t[1];
+}
+
+/* 4 samples at a time, each tap is loaded once for all phases */
+__attribute__((target("sse2"))) static float
+meter_tpeak_sse2(const float* in, uint32_t n, float pk)
+{
+	uint32_t i = 0;
+	const __m128 vabs = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+	__m128 vm = _mm_set1_ps(pk);
+	for (; i + 4 <= n; i += 4) {
+		__m128 y[TP_PHASES];
+		for (int p = 0; p < TP_PHASES; ++p) {
+			y[p] = _mm_setzero_ps();
+		}
+		for (int k = 0; k < TP_TAPS; ++k) {
+			const __m128 x = _mm_loadu_ps(&in[(int)i - k]);
+			for (int p = 0; p < TP_PHASES; ++p) {
+				y[p] = _mm_add_ps(y[p], _mm_mul_ps(_mm_set1_ps(tp_coeff[p][k]), x));
+			}
+		}
+		for (int p = 0; p < TP_PHASES; ++p) {
+			vm = _mm_max_ps(_mm_and_ps(y[p], vabs), vm);
+		}
+	}
+	return meter_tpeak_c(&in[i], n - i, hmax_sse2(vm));
+}
+
+/* AVX2 -- also used with AVX-512, meter blocks are short */
+
+__attribute__((target("avx2"))) static float
+meter_peak_avx2(const float* in, uint32_t n, float pk)
+{
+	uint32_t i = 0;
+	const __m256 vabs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 vm = _mm256_set1_ps(pk);
+	__m256 v1 = vm, v2 = vm, v3 = vm;
+	for (; i + 32 <= n; i += 32) {
+		vm = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(&in[i]), vabs), vm);
+		v1 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(&in[i + 8]), vabs), v1);
+		v2 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(&in[i + 16]), vabs), v2);
+		v3 = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(&in[i + 24]), vabs), v3);
+	}
+	vm = _mm256_max_ps(_mm256_max_ps(vm, v1), _mm256_max_ps(v2, v3));
+	for (; i + 8 <= n; i += 8) {
+		vm = _mm256_max_ps(_mm256_and_ps(_mm256_loadu_ps(&in[i]), vabs), vm);
+	}
+	const __m128 v = _mm_max_ps(_mm256_castps256_ps128(vm), _mm256_extractf128_ps(vm, 1));
+	return meter_peak_c(&in[i], n - i, hmax_sse2(v));
+}
+
+__attribute__((target("avx2"))) static float
+meter_sumsq_avx2(const float* in, uint32_t n)
+{
+	uint32_t i = 0;
+	__m256 vs = _mm256_setzero_ps();
+	for (; i + 8 <= n; i += 8) {
+		const __m256 x = _mm256_loadu_ps(&in[i]);
+		vs = _mm256_add_ps(vs, _mm256_mul_ps(x, x));
+	}
+	const __m128 v = _mm_add_ps(_mm256_castps256_ps128(vs), _mm256_extractf128_ps(vs, 1));
+	return hsum_sse2(v) + meter_sumsq_c(&in[i], n - i);
+}
+
+__attribute__((target("avx2"))) static void
+meter_sumsq2_avx2(const float* a, const float* b, uint32_t n, float* sp, float* sn)
+{
+	uint32_t i = 0;
+	__m256 vp = _mm256_setzero_ps();
+	__m256 vn = _mm256_setzero_ps();
+	for (; i + 8 <= n; i += 8) {
+		const __m256 va = _mm256_loadu_ps(&a[i]);
+		const __m256 vb = _mm256_loadu_ps(&b[i]);
+		const __m256 s  = _mm256_add_ps(va, vb);
+		const __m256 d  = _mm256_sub_ps(va, vb);
+		vp = _mm256_add_ps(vp, _mm256_mul_ps(s, s));
+		vn = _mm256_add_ps(vn, _mm256_mul_ps(d, d));
+	}
+	meter_sumsq2_c(&a[i], &b[i], n - i, sp, sn);
+	*sp += hsum_sse2(_mm_add_ps(_mm256_castps256_ps128(vp), _mm256_extractf128_ps(vp, 1)));
+	*sn += hsum_sse2(_mm_add_ps(_mm256_castps256_ps128(vn), _mm256_extractf128_ps(vn, 1)));
+}
+
+__attribute__((target("avx2"))) static float
+meter_energy2_avx2(const float* a, const float* b, uint32_t n, float* e, float pk)
+{
+	uint32_t i = 0;
+	__m256 vm = _mm256_set1_ps(pk);
+	for (; i + 8 <= n; i += 8) {
+		const __m256 va = _mm256_loadu_ps(&a[i]);
+		const __m256 vb = _mm256_loadu_ps(&b[i]);
+		const __m256 ve = _mm256_add_ps(_mm256_mul_ps(va, va), _mm256_mul_ps(vb, vb));
+		_mm256_storeu_ps(&e[i], ve);
+		vm = _mm256_max_ps(ve, vm);
+	}
+	const __m128 v = _mm_max_ps(_mm256_castps256_ps128(vm), _mm256_extractf128_ps(vm, 1));
+	return meter_energy2_c(&a[i], &b[i], n - i, &e[i], hmax_sse2(v));
+}
+
+/* squares of 16 samples: whole block and masked tail, folded to 4 lanes */
+#define SUMSQ16_AVX2(X, S, T) \
+	{ \
+		const __m256 x0 = _mm256_loadu_ps(&(X)[0]); \
+		const __m256 x1 = _mm256_loadu_ps(&(X)[8]); \
+		const __m256 q0 = _mm256_mul_ps(x0, x0); \
+		const __m256 q1 = _mm256_mul_ps(x1, x1); \
+		const __m256 s8 = _mm256_add_ps(q0, q1); \
+		const __m256 t8 = _mm256_add_ps(_mm256_and_ps(q0, m0), _mm256_and_ps(q1, m1)); \
+		S = _mm_add_ps(_mm256_castps256_ps128(s8), _mm256_extractf128_ps(s8, 1)); \
+		T = _mm_add_ps(_mm256_castps256_ps128(t8), _mm256_extractf128_ps(t8, 1)); \
+	}
+
+__attribute__((target("avx2"))) static void
+meter_sumsq16_avx2(const float* in, uint32_t nblk, uint32_t tpos, float* blk, float* tail)
+{
+	uint32_t b = 0;
+	LANE_MASK_16(lm, tpos);
+	const __m256 m0 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&lm[0]));
+	const __m256 m1 = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i*)&lm[8]));
+	for (; b + 4 <= nblk; b += 4, in += 64) {
+		__m128 s[4], t[4];
+		for (int j = 0; j < 4; ++j) {
+			SUMSQ16_AVX2(&in[16 * j], s[j], t[j]);
+		}
+		_mm_storeu_ps(&blk[b],  hsum4_sse2(s[0], s[1], s[2], s[3]));
+		_mm_storeu_ps(&tail[b], hsum4_sse2(t[0], t[1], t[2], t[3]));
+	}
+	for (; b < nblk; ++b, in += 16) {
+		__m128 s, t;
+		SUMSQ16_AVX2(in, s, t);
+		blk[b]  = hsum_sse2(s);
+		tail[b] = hsum_sse2(t);
+	}
+}
+
+/* two lanes only, the SSE2 kernel is as fast */
+#define meter_kweight_avx2 meter_kweight_sse2
+
+__attribute__((target("avx2"))) static float
+meter_tpeak_avx2(const float* in, uint32_t n, float pk)
+{
+	uint32_t i = 0;
+	const __m256 vabs = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+	__m256 vm = _mm256_set1_ps(pk);
+	for (; i + 8 <= n; i += 8) {
+		__m256 y[TP_PHASES];
+		for (int p = 0; p < TP_PHASES; ++p) {
+			y[p] = _mm256_setzero_ps();
+		}
+		for (int k = 0; k < TP_TAPS; ++k) {
+			const __m256 x = _mm256_loadu_ps(&in[(int)i - k]);
+			for (int p = 0; p < TP_PHASES; ++p) {
+				y[p] = _mm256_add_ps(y[p], _mm256_mul_ps(_mm256_set1_ps(tp_coeff[p][k]), x));
+			}
+		}
+		for (int p = 0; p < TP_PHASES; ++p) {
+			vm = _mm256_max_ps(_mm256_and_ps(y[p], vabs), vm);
+		}
+	}
+	const __m128 v = _mm_max_ps(_mm256_castps256_ps128(vm), _mm256_extractf128_ps(vm, 1));
+	return meter_tpeak_sse2(&in[i], n - i, hmax_sse2(v));
+}
+
+#endif /* BLC_X86_DISPATCH */
+
+/* flush denormals to zero (FTZ) and treat denormal inputs as zero
+ * (DAZ, x86 only) -- returns the previous state for fpu_restore() */
+
+#if defined __SSE__
+# include <xmmintrin.h>
+typedef unsigned int FPUState;
+
+static inline FPUState
+fpu_flush_denormals(void)
+{
+	const FPUState s = _mm_getcsr();
+	_mm_setcsr(s | 0x8040); // FTZ | DAZ
+	return s;
+}
+
+static inline void
+fpu_restore(const FPUState s)
+{
+	_mm_setcsr(s);
+}
+
+#elif defined __aarch64__ && defined __GNUC__
+typedef uint64_t FPUState;
+
+static inline FPUState
+fpu_flush_denormals(void)
+{
+	FPUState s;
+	__asm__ __volatile__("mrs %0, fpcr" : "=r" (s));
+	__asm__ __volatile__("msr fpcr, %0" : : "r" (s | (1 << 24))); // FZ
+	return s;
+}
+
+static inline void
+fpu_restore(const FPUState s)
+{
+	__asm__ __volatile__("msr fpcr, %0" : : "r" (s));
+}
+
+#else
+typedef int FPUState;
+static inline FPUState fpu_flush_denormals(void) { return 0; }
+static inline void fpu_restore(const FPUState s) { (void)s; }
+#endif
+
+#define SET_GAIN_KERNELS(K, ISA) \
+	(K)->gain       = gain_const_##ISA; \
+	(K)->ramp       = gain_ramp_##ISA; \
+	(K)->ramp_const = gain_ramp_const_##ISA;
+
+/* pick the best implementation for the CPU at hand */
+static void
+select_gain_kernels(GainKernels* k)
+{
+	SET_GAIN_KERNELS(k, c);
+#if defined BLC_X86_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f")) {
+		SET_GAIN_KERNELS(k, avx512);
+	} else if (__builtin_cpu_supports("avx2")) {
+		SET_GAIN_KERNELS(k, avx2);
+	} else if (__builtin_cpu_supports("sse2")) {
+		SET_GAIN_KERNELS(k, sse2);
+	}
+#elif defined BLC_NEON
+	SET_GAIN_KERNELS(k, neon);
+#endif
+}
+
+#define SET_METER_KERNELS(K, ISA) \
+	(K)->peak   = meter_peak_##ISA; \
+	(K)->sumsq  = meter_sumsq_##ISA; \
+	(K)->sumsq2 = meter_sumsq2_##ISA; \
+	(K)->energy2 = meter_energy2_##ISA; \
+	(K)->sumsq16 = meter_sumsq16_##ISA; \
+	(K)->tpeak  = meter_tpeak_##ISA; \
+	(K)->kweight = meter_kweight_##ISA;
+
+static void
+select_meter_kernels(MeterKernels* k)
+{
+	SET_METER_KERNELS(k, c);
+	k->fuse_level = 1;
+#if defined BLC_X86_DISPATCH
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		SET_METER_KERNELS(k, avx2);
+		k->fuse_level = 0;
+	} else if (__builtin_cpu_supports("sse2")) {
+		SET_METER_KERNELS(k, sse2);
+	}
+#endif
+}
+
+#endif
@@ -0,0 +1,666 @@
+/* balance -- LV2 stereo balance control
+ *
+ * Copyright (C) 2013 Robin Gareus <robin@gareus.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Metering building blocks. */
+
+#ifndef BLC_METERS_H
+#define BLC_METERS_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "kernels.h"
+
+/* RMS integrator: moving sum of squares over a window of `wlen`
+ * samples, evaluated at the end of every block of RMS_BLOCK samples.
+ *
+ * Only per-block sums are kept. The window is made of `wblk` whole
+ * blocks plus the last `wtail` samples of the block before them, so
+ * the sum is exact at block boundaries for any window length.
+ * The running sum is recomputed from the block sums every time the
+ * ring wraps, which stops rounding errors from accumulating.
+ */
+
+#define RMS_BLOCK (16)  // block size of the sumsq16 kernels
+#define RMS_BATCH (64)  // ring headroom [blocks], min. blocks per kernel call
+
+typedef struct {
+	float*   blk;   // ring: sum of squares of each block
+	float*   tail;  // ring: sum of squares of the last `wtail` samples of each block
+	uint32_t size;  // ring size [blocks]
+	uint32_t wlen;  // window [samples], 0: peak only
+	uint32_t wblk;  // window, whole blocks
+	uint32_t wtail; // window, remaining samples
+	uint32_t bidx;  // current block
+	uint32_t bpos;  // position in current block [samples]
+	double   norm;  // 1 / wlen
+	float    acc;   // current block sum
+	float    acct;  // current block tail sum
+	double   sum;   // sum of the last `wblk` complete blocks
+	double   esum;  // sum of squares of complete blocks, see rms_energy()
+} RMSIntegrator;
+
+/* allocate for windows of up to `max_len` samples */
+static int
+rms_init(RMSIntegrator* I, const uint32_t max_len)
+{
+	memset(I, 0, sizeof(RMSIntegrator));
+	I->size = max_len / RMS_BLOCK + 2 + RMS_BATCH;
+	I->blk  = (float*) calloc(I->size, sizeof(float));
+	I->tail = (float*) calloc(I->size, sizeof(float));
+	return (I->blk && I->tail) ? 0 : -1;
+}
+
+static void
+rms_free(RMSIntegrator* I)
+{
+	free(I->blk);
+	free(I->tail);
+}
+
+/* clear history, set window length [samples] */
+static void
+rms_reset(RMSIntegrator* I, const uint32_t wlen)
+{
+	I->wlen  = wlen;
+	I->wblk  = wlen / RMS_BLOCK;
+	I->wtail = wlen % RMS_BLOCK;
+	I->norm  = wlen > 0 ? 1.0 / wlen : 0;
+	I->bidx  = I->bpos = 0;
+	I->acc   = I->acct = 0;
+	I->sum   = 0;
+	I->esum  = 0;
+	memset(I->blk,  0, I->size * sizeof(float));
+	memset(I->tail, 0, I->size * sizeof(float));
+}
+
+/* blocks [bidx, bidx + nb) have been stored: slide the window.
+ * bidx + nb must not exceed the ring size. */
+static inline void
+rms_advance(RMSIntegrator* I, const uint32_t nb, double* const max)
+{
+	const float* const blk  = I->blk;
+	const float* const tail = I->tail;
+	const uint32_t size = I->size;
+	uint32_t j = I->bidx;
+	/* block that just left the window, its tail is still in */
+	uint32_t o = j >= I->wblk ? j - I->wblk : j + size - I->wblk;
+	double sum = I->sum;
+	double mx  = -INFINITY;
+	double e   = 0;
+
+	for (uint32_t b = 0; b < nb; ++b, ++j) {
+		e   += blk[j];
+		sum += (double) blk[j] - blk[o];
+		const double w = sum + tail[o];
+		if (w > mx) mx = w;
+		if (++o == size) o = 0;
+	}
+
+	mx *= I->norm;
+	if (mx > *max) *max = mx;
+	I->esum += e;
+
+	if (j == size) {
+		/* resync */
+		j = 0;
+		sum = 0;
+		for (uint32_t b = 1; b <= I->wblk; ++b) {
+			sum += blk[size - b];
+		}
+	}
+	I->sum  = sum;
+	I->bidx = j;
+}
+
+static inline void
+rms_block_end(RMSIntegrator* I, double* max)
+{
+	I->blk[I->bidx]  = I->acc;
+	I->tail[I->bidx] = I->acct;
+	I->acc = I->acct = 0;
+	I->bpos = 0;
+	rms_advance(I, 1, max);
+}
+
+/* feed `n` samples. Updates the absolute peak and the max of the
+ * moving average of squares (or of the squared peak if wlen == 0) */
+static inline void
+rms_run(RMSIntegrator* I, const MeterKernels* mk, const float* const x, const uint32_t n,
+		float* const peak, double* const max)
+{
+	uint32_t i = 0;
+	const float pk = *peak = mk->peak(x, n, *peak);
+
+	if (I->wlen == 0) {
+		if (n > 0 && (double)pk * pk > *max) {
+			*max = (double)pk * pk;
+		}
+		I->esum += mk->sumsq(x, n);
+		return;
+	}
+
+	const uint32_t tpos = RMS_BLOCK - I->wtail;
+
+	while (i < n) {
+		if (I->bpos == 0 && n - i >= RMS_BLOCK) {
+			/* whole blocks, stored in place. Blocks that are still
+			 * needed as the window's trailing edge must not be
+			 * overwritten: nb <= size - wblk */
+			uint32_t nb = (n - i) / RMS_BLOCK;
+			if (nb > I->size - I->bidx) nb = I->size - I->bidx;
+			if (nb > I->size - I->wblk) nb = I->size - I->wblk;
+			mk->sumsq16(&x[i], nb, tpos, &I->blk[I->bidx], &I->tail[I->bidx]);
+			rms_advance(I, nb, max);
+			i += nb * RMS_BLOCK;
+			continue;
+		}
+
+		const uint32_t bend = I->bpos < tpos ? tpos : RMS_BLOCK;
+		const uint32_t len  = (n - i < bend - I->bpos) ? n - i : bend - I->bpos;
+		const float s = mk->sumsq(&x[i], len);
+
+		I->acc += s;
+		if (I->bpos >= tpos) {
+			I->acct += s;
+		}
+		I->bpos += len;
+		i += len;
+
+		if (I->bpos == RMS_BLOCK) {
+			rms_block_end(I, max);
+		}
+	}
+}
+
+/* sum of squares of the blocks completed since the last call */
+static inline double
+rms_energy(RMSIntegrator* I)
+{
+	const double e = I->esum;
+	I->esum = 0;
+	return e;
+}
+
+/* `n` samples of digital silence, the window holds only zeros.
+ * Clear the ring along with the running sum and its rounding residue
+ * (block sums and running sum must stay consistent, see
+ * rms_advance()), then move on by `n` samples as rms_run() would */
+static inline void
+rms_silence(RMSIntegrator* I, const uint32_t n)
+{
+	if (I->size == 0) {
+		return; // not allocated
+	}
+	if (I->sum != 0 || I->acc != 0 || I->acct != 0) {
+		memset(I->blk,  0, I->size * sizeof(float));
+		memset(I->tail, 0, I->size * sizeof(float));
+		I->acc = I->acct = 0;
+		I->sum = 0;
+	}
+	I->bidx = (I->bidx + (I->bpos + n) / RMS_BLOCK) % I->size;
+	I->bpos = (I->bpos + n) % RMS_BLOCK;
+}
+
+/* Phase correlation: energy of the sum (L+R) and difference (L-R)
+ * over a sliding window.
+ *
+ * The window is split into PHASE_SEGMENTS segments and only one sum
+ * per segment is kept (512 bytes, regardless of window and rate).
+ * The oldest segment is weighted by the part of it that is still
+ * inside the window, assuming its energy is spread evenly. The
+ * correlation read from it stays within 0.05 of a per-sample moving
+ * sum, except while the edge of an abrupt change leaves the window:
+ * that edge is smeared over one segment (1/64 of the window).
+ * The window length is set by pc_reset() without reallocation.
+ */
+
+#define PHASE_SEGMENTS (64) // power of two
+
+typedef struct {
+	float    p[PHASE_SEGMENTS]; // ring: sum of (L+R)^2 of each segment
+	float    n[PHASE_SEGMENTS]; // ring: sum of (L-R)^2 of each segment
+	float    accp, accn;        // current segment
+	uint32_t seglen;            // segment length [samples]
+	uint32_t spos;              // position in current segment [samples]
+	uint32_t sidx;              // oldest segment, next to be replaced
+} PhaseCorrelator;
+
+/* clear history, set window length [samples] */
+static void
+pc_reset(PhaseCorrelator* P, const uint32_t wlen)
+{
+	memset(P, 0, sizeof(PhaseCorrelator));
+	P->seglen = wlen / PHASE_SEGMENTS;
+	if (P->seglen < 1) {
+		P->seglen = 1;
+	}
+}
+
+/* window length [samples] */
+static inline uint32_t
+pc_window(const PhaseCorrelator* P)
+{
+	return P->seglen * PHASE_SEGMENTS;
+}
+
+static inline void
+pc_run(PhaseCorrelator* P, const MeterKernels* mk,
+		const float* const l, const float* const r, const uint32_t n)
+{
+	uint32_t i = 0;
+	while (i < n) {
+		const uint32_t len = (n - i < P->seglen - P->spos) ? n - i : P->seglen - P->spos;
+
+		float sp, sn;
+		mk->sumsq2(&l[i], &r[i], len, &sp, &sn);
+		P->accp += sp;
+		P->accn += sn;
+		P->spos += len;
+		i += len;
+
+		if (P->spos == P->seglen) {
+			P->p[P->sidx] = P->accp;
+			P->n[P->sidx] = P->accn;
+			P->sidx = (P->sidx + 1) & (PHASE_SEGMENTS - 1);
+			P->accp = P->accn = 0;
+			P->spos = 0;
+		}
+	}
+}
+
+/* sum of squares of (L+R) and (L-R) over the window */
+static inline void
+pc_read(const PhaseCorrelator* P, double* const pos, double* const neg)
+{
+	const double w = 1.0 - P->spos / (double) P->seglen;
+	double sp = P->accp + w * P->p[P->sidx];
+	double sn = P->accn + w * P->n[P->sidx];
+	for (uint32_t s = 1; s < PHASE_SEGMENTS; ++s) {
+		const uint32_t j = (P->sidx + s) & (PHASE_SEGMENTS - 1);
+		sp += P->p[j];
+		sn += P->n[j];
+	}
+	*pos = sp;
+	*neg = sn;
+}
+
+/* True-peak meter: the sample peak of the 4x oversampled signal,
+ * ITU-R BS.1770-4 Annex 2. The kernel reads the input directly, only
+ * the first TP_TAPS - 1 outputs of each call need the history, which
+ * is kept inline (no allocation).
+ */
+
+typedef struct {
+	float buf[2 * (TP_TAPS - 1)]; // history, then the start of the current block
+} TruePeak;
+
+static void
+tp_reset(TruePeak* T)
+{
+	memset(T, 0, sizeof(TruePeak));
+}
+
+/* feed `n` samples, update the absolute true-peak */
+static inline void
+tp_run(TruePeak* T, const MeterKernels* mk, const float* const x, const uint32_t n, float* const peak)
+{
+	const uint32_t h  = TP_TAPS - 1;
+	const uint32_t n0 = n < h ? n : h;
+
+	memcpy(&T->buf[h], x, n0 * sizeof(float));
+	float pk = mk->tpeak(&T->buf[h], n0, *peak);
+	if (n > h) {
+		pk = mk->tpeak(&x[h], n - h, pk);
+	}
+	*peak = pk;
+
+	if (n >= h) {
+		memcpy(T->buf, &x[n - h], h * sizeof(float));
+	} else {
+		memmove(T->buf, &T->buf[n], h * sizeof(float));
+	}
+}
+
+/* EBU R128 loudness of a stereo pair (ITU-R BS.1770-4, EBU Tech 3341
+ * and 3342).
+ *
+ * The K-weighted signal is only kept as energies of 100 ms blocks:
+ * momentary (400 ms) and short-term (3 s) loudness are the means of
+ * the last 4 and 30 blocks. Integrated loudness and loudness range
+ * (LRA) use histograms of fixed size, 0.1 LU bins from the absolute
+ * gate (-70 LUFS) up, that hold the count and the energy sum of their
+ * blocks. Gating is exact except for the blocks in the bin of the
+ * relative gate, LRA is resolved to one bin.
+ */
+
+#define LUFS_BLOCKS (30)     // short-term window [100 ms blocks]
+#define LUFS_BINS   (800)    // -70 .. +10 LUFS
+#define LUFS_MIN    (-70.0)  // absolute gate
+#define LUFS_BINW   (0.1)    // [LU]
+
+typedef struct {
+	uint32_t cnt[LUFS_BINS];
+	double   sum[LUFS_BINS]; // energy
+} LoudnessHist;
+
+typedef struct {
+	double   coef[10];  // K-weighting, see MeterKernels.kweight
+	double   z[8];
+	uint32_t blen;      // 100 ms [samples]
+	uint32_t bpos;      // position in current block
+	double   acc;       // current block, sum of squares
+	double   blk[LUFS_BLOCKS]; // ring: energy (mean square) of each block
+	uint32_t bidx;      // next block
+	uint32_t nblk;      // blocks since reset, up to LUFS_BLOCKS
+	LoudnessHist hi;    // momentary blocks, integrated loudness
+	LoudnessHist hs;    // short-term values, LRA
+	float    momentary, shortterm, integrated; // [LUFS]
+	float    range;     // [LU]
+} Loudness;
+
+/* energy to LUFS, -inf below -200 (decaying filter tails) */
+static inline float
+lufs_db(const double e)
+{
+	return e > 1e-20 ? -0.691 + 10.0 * log10(e) : -INFINITY;
+}
+
+static void
+lufs_reset(Loudness* L)
+{
+	memset(L->z, 0, sizeof(L->z));
+	memset(L->blk, 0, sizeof(L->blk));
+	memset(&L->hi, 0, sizeof(LoudnessHist));
+	memset(&L->hs, 0, sizeof(LoudnessHist));
+	L->bpos = L->bidx = L->nblk = 0;
+	L->acc = 0;
+	L->momentary = L->shortterm = L->integrated = -INFINITY;
+	L->range = 0;
+}
+
+static void
+lufs_init(Loudness* L, const double rate)
+{
+	/* pre-filter (high shelf) */
+	double f0 = 1681.974450955533;
+	double Q  = 0.7071752369554196;
+	double K  = tan(M_PI * f0 / rate);
+	const double Vh = pow(10.0, 3.999843853973347 / 20.0);
+	const double Vb = pow(Vh, 0.4996667741545416);
+	double a0 = 1.0 + K / Q + K * K;
+	L->coef[0] = (Vh + Vb * K / Q + K * K) / a0;
+	L->coef[1] = 2.0 * (K * K - Vh) / a0;
+	L->coef[2] = (Vh - Vb * K / Q + K * K) / a0;
+	L->coef[3] = 2.0 * (K * K - 1.0) / a0;
+	L->coef[4] = (1.0 - K / Q + K * K) / a0;
+
+	/* RLB high-pass */
+	f0 = 38.13547087602444;
+	Q  = 0.5003270373238773;
+	K  = tan(M_PI * f0 / rate);
+	a0 = 1.0 + K / Q + K * K;
+	L->coef[5] = 1.0;
+	L->coef[6] = -2.0;
+	L->coef[7] = 1.0;
+	L->coef[8] = 2.0 * (K * K - 1.0) / a0;
+	L->coef[9] = (1.0 - K / Q + K * K) / a0;
+
+	L->blen = rint(0.1 * rate);
+	lufs_reset(L);
+}
+
+static void
+lufs_hist_add(LoudnessHist* H, const double e)
+{
+	const float l = lufs_db(e);
+	if (!(l > LUFS_MIN)) {
+		return;
+	}
+	int b = (l - LUFS_MIN) / LUFS_BINW;
+	if (b >= LUFS_BINS) b = LUFS_BINS - 1;
+	++H->cnt[b];
+	H->sum[b] += e;
+}
+
+/* first bin at or above the relative gate, `rel` LU below the mean */
+static int
+lufs_hist_gate(const LoudnessHist* H, const double rel, uint32_t* n)
+{
+	uint32_t cnt = 0;
+	double   sum = 0;
+	for (int b = 0; b < LUFS_BINS; ++b) {
+		cnt += H->cnt[b];
+		sum += H->sum[b];
+	}
+	*n = cnt;
+	if (cnt == 0) {
+		return LUFS_BINS;
+	}
+	const double gate = lufs_db(sum / cnt) + rel;
+	const int b = floor((gate - LUFS_MIN) / LUFS_BINW + .5);
+	return b < 0 ? 0 : b;
+}
+
+static void
+lufs_update(Loudness* L)
+{
+	uint32_t n;
+	int b0 = lufs_hist_gate(&L->hi, -10.0, &n);
+	uint32_t cnt = 0;
+	double   sum = 0;
+	for (int b = b0; b < LUFS_BINS; ++b) {
+		cnt += L->hi.cnt[b];
+		sum += L->hi.sum[b];
+	}
+	L->integrated = cnt > 0 ? lufs_db(sum / cnt) : -INFINITY;
+
+	/* LRA: 10th to 95th percentile of the gated short-term values */
+	b0 = lufs_hist_gate(&L->hs, -20.0, &n);
+	cnt = 0;
+	for (int b = b0; b < LUFS_BINS; ++b) {
+		cnt += L->hs.cnt[b];
+	}
+	L->range = 0;
+	if (cnt > 0) {
+		const uint32_t lo = floor(.10 * (cnt - 1));
+		const uint32_t hi = floor(.95 * (cnt - 1));
+		int blo = -1, bhi = -1;
+		uint32_t c = 0;
+		for (int b = b0; b < LUFS_BINS && bhi < 0; ++b) {
+			c += L->hs.cnt[b];
+			if (blo < 0 && c > lo) blo = b;
+			if (c > hi) bhi = b;
+		}
+		L->range = (bhi - blo) * LUFS_BINW;
+	}
+}
+
+static void
+lufs_block_end(Loudness* L)
+{
+	L->blk[L->bidx] = L->acc / L->blen;
+	L->bidx = (L->bidx + 1) % LUFS_BLOCKS;
+	L->acc  = 0;
+	L->bpos = 0;
+	if (L->nblk < LUFS_BLOCKS) {
+		++L->nblk;
+	}
+
+	/* the ring is zeroed on reset: short windows start with silence */
+	double em = 0, es = 0;
+	for (uint32_t k = 1; k <= LUFS_BLOCKS; ++k) {
+		const double e = L->blk[(L->bidx + LUFS_BLOCKS - k) % LUFS_BLOCKS];
+		if (k <= 4) em += e;
+		es += e;
+	}
+	em /= 4;
+	es /= LUFS_BLOCKS;
+
+	L->momentary = lufs_db(em);
+	L->shortterm = lufs_db(es);
+	if (L->nblk >= 4) {
+		lufs_hist_add(&L->hi, em);
+	}
+	if (L->nblk >= LUFS_BLOCKS) {
+		lufs_hist_add(&L->hs, es);
+	}
+	lufs_update(L);
+}
+
+static inline void
+lufs_run(Loudness* L, const MeterKernels* mk,
+		const float* const l, const float* const r, const uint32_t n)
+{
+	uint32_t i = 0;
+	while (i < n) {
+		const uint32_t len = (n - i < L->blen - L->bpos) ? n - i : L->blen - L->bpos;
+		L->acc += mk->kweight(&l[i], &r[i], len, L->coef, L->z);
+		L->bpos += len;
+		i += len;
+		if (L->bpos == L->blen) {
+			lufs_block_end(L);
+		}
+	}
+}
+
+/* `n` samples of digital silence, the filters have settled */
+static void
+lufs_silence(Loudness* L, uint32_t n)
+{
+	memset(L->z, 0, sizeof(L->z));
+	while (n > 0) {
+		const uint32_t len = (n < L->blen - L->bpos) ? n : L->blen - L->bpos;
+		L->bpos += len;
+		n -= len;
+		if (L->bpos == L->blen) {
+			lufs_block_end(L);
+		}
+	}
+}
+
+/* Long-term L/R level ratio for the balance suggestion. It is fed
+ * the mean square of each channel per meter update, only block
+ * summaries, no per-sample work. Updates where both channels are
+ * below an absolute gate, or more than BAL_GATE_REL below the mean of
+ * the updates counted so far, do not count (pauses, reverb tails).
+ */
+
+#define BAL_GATE_ABS (1e-6) // -60 dBFS, mean square
+#define BAL_GATE_REL (0.01) // -20 dB
+#define BAL_RATIO_MAX (40.f) // [dB]
+
+typedef struct {
+	double   sum[2]; // mean squares of the gated updates
+	uint32_t cnt;
+} BalanceStat;
+
+static inline void
+bal_reset(BalanceStat* B)
+{
+	B->sum[0] = B->sum[1] = 0;
+	B->cnt = 0;
+}
+
+static inline void
+bal_add(BalanceStat* B, const double l, const double r)
+{
+	const double e = l > r ? l : r;
+	if (!(e > BAL_GATE_ABS)) {
+		return;
+	}
+	if (B->cnt > 0 && e * B->cnt < BAL_GATE_REL * (B->sum[0] > B->sum[1] ? B->sum[0] : B->sum[1])) {
+		return;
+	}
+	B->sum[0] += l;
+	B->sum[1] += r;
+	++B->cnt;
+}
+
+/* [dB] > 0: left is louder */
+static inline float
+bal_ratio(const BalanceStat* B)
+{
+	if (B->sum[0] <= 0) return -BAL_RATIO_MAX;
+	if (B->sum[1] <= 0) return BAL_RATIO_MAX;
+	const float r = 10.f * log10(B->sum[0] / B->sum[1]);
+	return r < -BAL_RATIO_MAX ? -BAL_RATIO_MAX : (r > BAL_RATIO_MAX ? BAL_RATIO_MAX : r);
+}
+
+/* Wait-free single-producer, single-consumer ring of floats, used to
+ * hand audio to the metering worker. Each side only writes its own
+ * index. A record becomes visible to the reader only once
+ * ar_commit() publishes it as a whole.
+ */
+
+typedef struct {
+	float*   buf;
+	uint32_t size;  // [floats], power of two
+	uint32_t wr;    // producer
+	uint32_t rd;    // consumer
+} AnalysisRing;
+
+static inline uint32_t
+ar_write_space(const AnalysisRing* R)
+{
+	const uint32_t rd = __atomic_load_n(&R->rd, __ATOMIC_ACQUIRE);
+	return R->size - 1 - ((R->wr - rd) & (R->size - 1));
+}
+
+static inline uint32_t
+ar_read_space(const AnalysisRing* R)
+{
+	const uint32_t wr = __atomic_load_n(&R->wr, __ATOMIC_ACQUIRE);
+	return (wr - R->rd) & (R->size - 1);
+}
+
+/* copy to the write position + `off`, does not publish */
+static inline void
+ar_put(AnalysisRing* R, const uint32_t off, const float* const src, const uint32_t n)
+{
+	const uint32_t p = (R->wr + off) & (R->size - 1);
+	const uint32_t n1 = (n < R->size - p) ? n : R->size - p;
+	memcpy(&R->buf[p], src, n1 * sizeof(float));
+	memcpy(R->buf, &src[n1], (n - n1) * sizeof(float));
+}
+
+static inline void
+ar_commit(AnalysisRing* R, const uint32_t n)
+{
+	__atomic_store_n(&R->wr, (R->wr + n) & (R->size - 1), __ATOMIC_RELEASE);
+}
+
+/* copy from the read position + `off` */
+static inline void
+ar_get(const AnalysisRing* R, const uint32_t off, float* const dst, const uint32_t n)
+{
+	const uint32_t p = (R->rd + off) & (R->size - 1);
+	const uint32_t n1 = (n < R->size - p) ? n : R->size - p;
+	memcpy(dst, &R->buf[p], n1 * sizeof(float));
+	memcpy(&dst[n1], R->buf, (n - n1) * sizeof(float));
+}
+
+static inline void
+ar_release(AnalysisRing* R, const uint32_t n)
+{
+	__atomic_store_n(&R->rd, (R->rd + n) & (R->size - 1), __ATOMIC_RELEASE);
+}
+
+#endif
@@ -114,6 +114,9 @@ using namespace FTGL;
 /* ui-model scale -- on screen we use [-1..+1] orthogonal projection */
 #define SCALE (0.2f)
 
+/* changes below the meter resolution are not sent by the plugin */
+#define METER_DEADBAND (.1) // [dB]
+
 #define MOUSEZ (-.04)
 #define SIDEVZ (.15)
 
@@ -201,6 +204,15 @@ typedef struct {
   float p_phase_out;
 
   int link_delay;
+  float al_delay; // [s] result of the alignment analysis
+  float bal_suggest; // balance that matches L/R input levels
+  int   bal_valid;
+
+  /* multiband phase correlation, see BANDS_FRAME_ID */
+  int      bd_bpo;   // bands per octave, 0: off, -1: as received
+  int      bd_first; // index of the first band
+  uint32_t bd_n;     // number of bands, 0: broadband meter
+  float    bd_val[BANDS_FRAME_MAX];
 
   FTGLfont *font_small;
 } BLCui;
@@ -459,6 +471,10 @@ static void notifyPlugin(PuglView* view, int elem) {
     const float val = elem - 7;
     ui->write(ui->controller, 7, sizeof(float), 0, (const void*)&val);
     return;
+  } else if (elem == 5 || elem == 6) {
+    /* delay dials control the [ms] ports */
+    const float val = vmap_val(view, elem);
+    ui->write(ui->controller, elem + 9, sizeof(float), 0, (const void*)&val);
   } else {
     const float val = vmap_val(view, elem);
     ui->write(ui->controller, elem, sizeof(float), 0, (const void*)&val);
@@ -574,7 +590,7 @@ static void dialfmt_balance(PuglView* view, char* out, int elem) {
 
 static void dialfmt_delay(PuglView* view, char* out, int elem) {
   BLCui* ui = (BLCui*)puglGetHandle(view);
-  sprintf(out, "%.0fsm", ui->ctrls[elem].cur);
+  sprintf(out, "%.2fms", ui->ctrls[elem].cur);
 }
 
 static void dialfmt_meterint(PuglView* view, char* out, int elem) {
@@ -1270,7 +1286,35 @@ onDisplay(PuglView* view)
   peak_meter(view,  4.462, ui->p_mtr_out[0], ui->p_peak_out[0]);
   peak_meter(view,  4.76, ui->p_mtr_out[1], ui->p_peak_out[1]);
 
-  if (1) { /* phase meter */
+  if (ui->bd_n > 0) { /* phase meter per band, low to high frequencies */
+    const GLfloat col_black[] =  { 0.0, 0.0, 0.0, 0.8 };
+    const GLfloat col_zero[] =   { 0.5, 0.5, 0.5, 0.9 };
+    const float w = 6.0 / ui->bd_n;
+    const float y = -8.6;
+    unity_box2d(view, -3.0, 3.0, -8.9, -8.3, 0, col_black);
+    unity_box2d(view, -3.0, 3.0, y - .01, y + .01, -.01, col_zero);
+    for (uint32_t b = 0; b < ui->bd_n; ++b) {
+      const float v = MAX(-1, MIN(1, ui->bd_val[b]));
+      const float x = -3.0 + b * w;
+      if (v > 0.01) {
+        const GLfloat col_pos[] = { 0.0, 1.0, 0.0, 0.9 };
+        unity_box2d(view, x + .02, x + w - .02, y, y + .27 * v, -.02, col_pos);
+      } else if (v < -0.01) {
+        const GLfloat col_neg[] = { 1.0, 0.0, 0.0, 0.9 };
+        unity_box2d(view, x + .02, x + w - .02, y + .27 * v, y, -.02, col_neg);
+      }
+    }
+    const float lo = 1000.0 * powf(2, ui->bd_first / (float)ui->bd_bpo);
+    const float hi = 1000.0 * powf(2, (ui->bd_first + (int)ui->bd_n - 1) / (float)ui->bd_bpo);
+    if (hi < 1000) {
+      sprintf(tval, "%.0f..%.0fHz", lo, hi);
+    } else if (lo < 1000) {
+      sprintf(tval, "%.0fHz..%.1fkHz", lo, hi / 1000.0);
+    } else {
+      sprintf(tval, "%.1f..%.1fkHz", lo / 1000.0, hi / 1000.0);
+    }
+    render_text(view, tval, -3.0, -8.1, -0.01f, 5, text_gry);
+  } else { /* phase meter */
     const GLfloat col_black[] =  { 0.0, 0.0, 0.0, 0.5 };
     const GLfloat col_pos[] =    { 0.0, 1.0, 0.0, 0.9 };
     const GLfloat col_neg[] =    { 1.0, 0.0, 0.0, 0.9 };
@@ -1377,6 +1421,31 @@ onKeyboard(PuglView* view, bool press, uint32_t key)
       ui->off[0] = ui->off[1] = ui->off[2] = 0.0;
       queue_reshape = 1;
       break;
+    case 't':
+      /* analyze inter-channel delay, apply the result */
+      forge_message_kv(ui, ui->uris.blc_meters_cfg, 10, 2);
+      break;
+    case 'b':
+      /* match L/R level */
+      if (ui->bal_valid) {
+        ui->ctrls[3].cur = ui->bal_suggest;
+        notifyPlugin(view, 3);
+        puglPostRedisplay(view);
+      }
+      break;
+    case 'B':
+      /* restart the level statistics */
+      forge_message_kv(ui, ui->uris.blc_meters_cfg, 11, 0);
+      break;
+    case 'm':
+      /* phase correlation: broadband, 1 or 3 bands per octave */
+      ui->bd_bpo = ui->bd_bpo == 1 ? 3 : ui->bd_bpo == 3 ? 0 : 1;
+      forge_message_kv(ui, ui->uris.blc_meters_cfg, 12, ui->bd_bpo);
+      if (ui->bd_bpo == 0) {
+        ui->bd_n = 0;
+        puglPostRedisplay(view);
+      }
+      break;
     case 'e':
       ui->scale = 1.0;
       ui->rot[0] = 0;
@@ -1414,12 +1483,15 @@ onScroll(PuglView* view, int x, int y, float dx, float dy)
 	/* -1..+1 float dial */
 	ui->dndval = ui->ctrls[i].cur + SIGNUM(dy) * .01;
       } else if (ui->link_delay && (i == 5 || i == 6)) {
-	/* delay lengths when linked */
+	/* delay lengths when linked, 20us steps */
 	const int linked = (i == 6) ? 5 : 6;
 	ui->dndval = ui->ctrls[i].cur;
 	ui->dndval2 = ui->ctrls[linked].cur;
-	processLinkedMotion2(view, i, SIGNUM(dy));
+	processLinkedMotion2(view, i, SIGNUM(dy) * .02);
 	return;
+      } else if (i == 5 || i == 6) {
+	/* delay lengths [ms], 20us steps */
+	ui->dndval = ui->ctrls[i].cur + SIGNUM(dy) * .02;
       } else {
 	ui->dndval = ui->ctrls[i].cur + SIGNUM(dy);
       }
@@ -1621,6 +1693,8 @@ static int blc_gui_setup(BLCui* ui, const LV2_Feature* const* features) {
   ui->dndx       = 0.0;
   ui->dndy       = 0.0;
   ui->link_delay = 0;
+  ui->bd_bpo     = -1;
+  ui->bd_n       = 0;
 
   ui->p_bal[0] = ui->p_bal[1] = 0;
   ui->p_dly[0] = ui->p_dly[1] = 0;
@@ -1700,8 +1774,9 @@ static int blc_gui_setup(BLCui* ui, const LV2_Feature* const* features) {
   CTRLELEM(3,  OBJ_DIAL, -1, 1, 0,         0,  1.2,  1.5, 1.5, 1, 1, dialfmt_balance); // balance
   CTRLELEM(4,  OBJ_DIAL,  -2, 0, -2,     2.6,  0.8,  1.5, 1.5, .5, 1, NULL); // mode
 
-  CTRLELEM(5,  OBJ_DIAL,  0, 2000, 0,   -2.6, -1.0,  1.5, 1.5, 1, 1, dialfmt_delay);
-  CTRLELEM(6,  OBJ_DIAL,  0, 2000, 0,    2.6, -1.0,  1.5, 1.5, 1, 1, dialfmt_delay);
+  // MAXDELAY_MS -- from balance.c
+  CTRLELEM(5,  OBJ_DIAL,  0, 50, 0,     -2.6, -1.0,  1.5, 1.5, 1, 1, dialfmt_delay);
+  CTRLELEM(6,  OBJ_DIAL,  0, 50, 0,      2.6, -1.0,  1.5, 1.5, 1, 1, dialfmt_delay);
   CTRLELEM(12, OBJ_PUSHBUTTON, 0, 1, 0,  0, -1.0,  1.0, 1.0, 0.7, 8, NULL); // link
 
   CTRLELEM(8,  OBJ_BUTTON, 0, 1, 0, -2.60, -3.10,  1.3, 2.0, .8, 3, NULL); // ll
@@ -1775,6 +1850,7 @@ instantiate(const LV2UI_Descriptor*   descriptor,
 #endif
 
   *widget = (void*)puglGetNativeWindow(ui->view);
+  forge_message_kv(ui, ui->uris.blc_meters_cfg, 8, METER_DEADBAND);
   forge_message_kv(ui, ui->uris.blc_meters_on, 0, 0);
 
   pthread_mutex_lock (&instance_lock);
@@ -1810,6 +1886,63 @@ cleanup(LV2UI_Handle handle)
   free(ui);
 }
 
+/* alignment analysis: delay the channel that leads */
+static void
+apply_alignment(BLCui* ui)
+{
+  const float ms = ui->al_delay * 1000.0;
+  const float zero = 0;
+  ui->ctrls[5].cur = MAX(0, ms);
+  ui->ctrls[6].cur = MAX(0, -ms);
+  notifyPlugin(ui->view, 5);
+  notifyPlugin(ui->view, 6);
+  /* the estimate is the total delay, clear the [samples] ports */
+  ui->write(ui->controller, 5, sizeof(float), 0, (const void*)&zero);
+  ui->write(ui->controller, 6, sizeof(float), 0, (const void*)&zero);
+}
+
+/* apply a value received from the plugin, returns 0 if ignored */
+static int
+set_value(BLCui* ui, const int k, const float v)
+{
+  switch (k) {
+    case GAIN_LEFT:       ui->p_bal[0] = v; break;
+    case GAIN_RIGHT:      ui->p_bal[1] = v; break;
+    case DELAY_LEFT:      ui->p_dly[0] = v * 1000.0; break;
+    case DELAY_RIGHT:     ui->p_dly[1] = v * 1000.0; break;
+    case METER_IN_LEFT:   ui->p_mtr_in[0] = iec_scale(v) * 0.01; break;
+    case METER_IN_RIGHT:  ui->p_mtr_in[1] = iec_scale(v) * 0.01; break;
+    case METER_OUT_LEFT:  ui->p_mtr_out[0] = iec_scale(v) * 0.01; break;
+    case METER_OUT_RIGHT: ui->p_mtr_out[1] = iec_scale(v) * 0.01; break;
+    case PEAK_IN_LEFT:    ui->p_peak_in[0] = iec_scale(v) * 0.01; break;
+    case PEAK_IN_RIGHT:   ui->p_peak_in[1] = iec_scale(v) * 0.01; break;
+    case PEAK_OUT_LEFT:   ui->p_peak_out[0] = iec_scale(v) * 0.01; break;
+    case PEAK_OUT_RIGHT:  ui->p_peak_out[1] = iec_scale(v) * 0.01; break;
+    case PHASE_OUT:       ui->p_phase_out = v; break;
+    case CFG_INTEGRATE:   ui->ctrls[13].cur = v * 10000.0; break;
+    case CFG_FALLOFF:     parse_meterfall(ui->view, 14, v); break;
+    case CFG_HOLDTIME:    ui->ctrls[15].cur = v * 4.0; break;
+    case ALIGN_DELAY:     ui->al_delay = v; break;
+    case ALIGN_STATUS:    if (v == 2) apply_alignment(ui); break;
+    case BALANCE_SUGGEST: ui->bal_suggest = v; ui->bal_valid = 1; return 0;
+    default:
+      return 0;
+  }
+  return 1;
+}
+
+static void
+redisplay(BLCui* ui)
+{
+  puglPostRedisplay(ui->view);
+#if (defined OLD_SUIL && defined THREADSYNC)
+  if (pthread_mutex_trylock (&msg_thread_lock) == 0) {
+    pthread_cond_signal (&data_ready);
+    pthread_mutex_unlock (&msg_thread_lock);
+  }
+#endif
+}
+
 static void
 port_event(LV2UI_Handle handle,
     uint32_t     port_index,
@@ -1820,8 +1953,15 @@ port_event(LV2UI_Handle handle,
   BLCui* ui = (BLCui*)handle;
 
   if ( format == 0 ) {
-    if (port_index >= TOTAL_OBJ) return;
     float value =  *(float *)buffer;
+    if (port_index == 5 || port_index == 6) {
+      /* [samples] delay, the effective delay is reported by the plugin */
+      return;
+    } else if (port_index == 14 || port_index == 15) {
+      port_index -= 9;
+    } else if (port_index >= 12) {
+      return;
+    }
     rmap_val(ui->view, port_index, value);
     puglPostRedisplay(ui->view);
     return;
@@ -1831,6 +1971,37 @@ port_event(LV2UI_Handle handle,
   }
 
   LV2_Atom* atom = (LV2_Atom*)buffer;
+  if (atom->type == ui->uris.atom_Vector) {
+    uint32_t seq, mask, bpo, n;
+    int first;
+    float val[BANDS_FRAME_MAX > MTR_FRAME_KEYS ? BANDS_FRAME_MAX : MTR_FRAME_KEYS];
+    if (!get_bandsframe(&ui->uris, atom, &bpo, &first, &n, val)) {
+      /* ignore frames of a previous setting that are still in transit */
+      if (ui->bd_bpo < 0 || (uint32_t)ui->bd_bpo == bpo) {
+        ui->bd_bpo   = bpo;
+        ui->bd_first = first;
+        ui->bd_n     = n;
+        memcpy(ui->bd_val, val, n * sizeof(float));
+        redisplay(ui);
+      }
+      return;
+    }
+    /* vectorscope frames (SCOPE_FRAME_ID) are not displayed */
+    if (get_meterframe(&ui->uris, atom, &seq, &mask, val)) {
+      return;
+    }
+    int changed = 0;
+    for (int k = 0; k < MTR_FRAME_KEYS; ++k) {
+      if (mask & (1u << k)) {
+        changed |= set_value(ui, k, val[k]);
+      }
+    }
+    if (changed) {
+      redisplay(ui);
+    }
+    return;
+  }
+
   if (atom->type != ui->uris.atom_Blank && atom->type != ui->uris.atom_Object) {
     return;
   }
@@ -1840,33 +2011,9 @@ port_event(LV2UI_Handle handle,
     return;
   }
 
-  switch (k) {
-    case GAIN_LEFT:       ui->p_bal[0] = v; break;
-    case GAIN_RIGHT:      ui->p_bal[1] = v; break;
-    case DELAY_LEFT:      ui->p_dly[0] = v * 1000.0; break;
-    case DELAY_RIGHT:     ui->p_dly[1] = v * 1000.0; break;
-    case METER_IN_LEFT:   ui->p_mtr_in[0] = iec_scale(v) * 0.01; break;
-    case METER_IN_RIGHT:  ui->p_mtr_in[1] = iec_scale(v) * 0.01; break;
-    case METER_OUT_LEFT:  ui->p_mtr_out[0] = iec_scale(v) * 0.01; break;
-    case METER_OUT_RIGHT: ui->p_mtr_out[1] = iec_scale(v) * 0.01; break;
-    case PEAK_IN_LEFT:    ui->p_peak_in[0] = iec_scale(v) * 0.01; break;
-    case PEAK_IN_RIGHT:   ui->p_peak_in[1] = iec_scale(v) * 0.01; break;
-    case PEAK_OUT_LEFT:   ui->p_peak_out[0] = iec_scale(v) * 0.01; break;
-    case PEAK_OUT_RIGHT:  ui->p_peak_out[1] = iec_scale(v) * 0.01; break;
-    case PHASE_OUT:       ui->p_phase_out = v; break;
-    case CFG_INTEGRATE:   ui->ctrls[13].cur = v * 10000.0; break;
-    case CFG_FALLOFF:     parse_meterfall(ui->view, 14, v); break;
-    case CFG_HOLDTIME:    ui->ctrls[15].cur = v * 4.0; break;
-    default:
-      return;
+  if (set_value(ui, k, v)) {
+    redisplay(ui);
   }
-  puglPostRedisplay(ui->view);
-#if (defined OLD_SUIL && defined THREADSYNC)
-  if (pthread_mutex_trylock (&msg_thread_lock) == 0) {
-    pthread_cond_signal (&data_ready);
-    pthread_mutex_unlock (&msg_thread_lock);
-  }
-#endif
 }
 
 /******************************************************************************
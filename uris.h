@@ -30,6 +30,9 @@
 #endif
 
 #define BLC_URI "http://gareus.org/oss/lv2/balance"
+#define BLC_URI_51 BLC_URI "#surround51"  // N-channel conditioners
+#define BLC_URI_71 BLC_URI "#surround71"
+#define BLC_URI_16 BLC_URI "#channels16"
 
 #define BLC__cckey    BLC_URI "#controlkey"
 #define BLC__ccval    BLC_URI "#controlval"
@@ -51,6 +54,8 @@ typedef struct {
 	LV2_URID atom_Path;
 	LV2_URID atom_String;
 	LV2_URID atom_Int;
+	LV2_URID atom_Float;
+	LV2_URID atom_Vector;
 	LV2_URID atom_URID;
 	LV2_URID atom_eventTransfer;
 	LV2_URID atom_Sequence;
@@ -86,9 +91,71 @@ enum {
 	PHASE_OUT,
 	CFG_INTEGRATE,
 	CFG_FALLOFF,
-	CFG_HOLDTIME
+	CFG_HOLDTIME,
+	CFG_PHASE_WINDOW,
+	TRUEPEAK_IN_LEFT,
+	TRUEPEAK_IN_RIGHT,
+	TRUEPEAK_OUT_LEFT,
+	TRUEPEAK_OUT_RIGHT,
+	LOUDNESS_MOMENTARY,
+	LOUDNESS_SHORT,
+	LOUDNESS_INTEGRATED,
+	LOUDNESS_RANGE,
+	ALIGN_DELAY,      // [s] > 0: the right channel lags, delay the left one
+	ALIGN_POLARITY,   // -1: inverted
+	ALIGN_CONFIDENCE, // 0..1
+	ALIGN_STATUS,     // 0: no estimate, 1: analyzed, 2: analyzed, apply
+	BALANCE_RATIO,    // [dB] long-term input level L/R, > 0: left is louder
+	BALANCE_SUGGEST,  // balance setting that matches L/R for the current gain mode
+	NUMERIC_KEYS      // number of keys, keep last
 };
 
+// meters to run: value of blc_meters_on and of meter cfg key 6,
+// 0: MTR_ALL (true-peak and loudness meters are only run on request)
+enum {
+	MTR_LEVEL_IN     = 1,
+	MTR_LEVEL_OUT    = 2,
+	MTR_PHASE        = 4,
+	MTR_ALL          = 7,
+	MTR_TRUEPEAK_IN  = 8,
+	MTR_TRUEPEAK_OUT = 16,
+	MTR_LOUDNESS     = 32,
+	MTR_MASK         = 63
+};
+
+/* Meter readings are sent to the UI as a single atom:Vector of
+ * atom:Float per cycle: a header of version, sequence number and the
+ * set of keys that follow (bit per key, as two 16 bit halves), then
+ * the values of these keys in ascending order.
+ * Gain, delay, meter configuration and alignment results remain
+ * key/value messages.
+ */
+#define MTR_FRAME_VERSION (1)
+#define MTR_FRAME_HEAD    (4)
+#define MTR_FRAME_KEYS    (32)
+#define MTR_FRAME_SEQ     (1 << 24) // sequence wraps, floats are exact below
+
+// keys are bits of a 32 bit mask, new keys need a wider frame header
+static_assert(NUMERIC_KEYS <= MTR_FRAME_KEYS, "numeric keys exceed the meter frame mask");
+
+/* Multiband phase correlation, a separate atom:Vector of atom:Float:
+ * BANDS_FRAME_ID, bands per octave, index of the first band, number of
+ * bands, then the correlation of each band. The center frequency of
+ * band index i is 1 kHz * 2^(i / bands per octave).
+ */
+#define BANDS_FRAME_ID   (256)
+#define BANDS_FRAME_HEAD (4)
+#define BANDS_FRAME_MAX  (32)
+
+/* Vectorscope, a separate atom:Vector of atom:Float:
+ * SCOPE_FRAME_ID, mode (1: L,R  2: M,S), number of points, decimation
+ * [samples per point], then the x,y pairs of SCOPE_POINTS points.
+ * Sent only on request (meter cfg key 13), for custom UIs: the built-in
+ * GUI does not display it.
+ */
+#define SCOPE_FRAME_ID   (257)
+#define SCOPE_FRAME_HEAD (4)
+#define SCOPE_POINTS     (128)
 
 static inline void
 map_balance_uris(LV2_URID_Map* map, balanceURIs* uris)
@@ -98,6 +165,8 @@ map_balance_uris(LV2_URID_Map* map, balanceURIs* uris)
 	uris->atom_Path          = map->map(map->handle, LV2_ATOM__Path);
 	uris->atom_String        = map->map(map->handle, LV2_ATOM__String);
 	uris->atom_Int           = map->map(map->handle, LV2_ATOM__Int);
+	uris->atom_Float         = map->map(map->handle, LV2_ATOM__Float);
+	uris->atom_Vector        = map->map(map->handle, LV2_ATOM__Vector);
 	uris->atom_URID          = map->map(map->handle, LV2_ATOM__URID);
 	uris->atom_eventTransfer = map->map(map->handle, LV2_ATOM__eventTransfer);
   uris->atom_Sequence      = map->map(map->handle, LV2_ATOM__Sequence);
@@ -155,4 +224,146 @@ get_cc_key_value(
 	return 0;
 }
 
+static inline LV2_Atom *
+forge_meterframe(LV2_Atom_Forge* forge,
+		const balanceURIs* uris, const int64_t time,
+		const uint32_t seq, const uint32_t mask, const float* const val)
+{
+	float frame[MTR_FRAME_HEAD + MTR_FRAME_KEYS];
+	uint32_t n = MTR_FRAME_HEAD;
+	frame[0] = MTR_FRAME_VERSION;
+	frame[1] = seq % MTR_FRAME_SEQ;
+	frame[2] = mask & 0xffff;
+	frame[3] = mask >> 16;
+	for (int k = 0; k < MTR_FRAME_KEYS; ++k) {
+		if (mask & (1u << k)) {
+			frame[n++] = val[k];
+		}
+	}
+	lv2_atom_forge_frame_time(forge, time);
+	return (LV2_Atom*)lv2_atom_forge_vector(forge, sizeof(float), uris->atom_Float, n, frame);
+}
+
+/* unpack a meter frame, `val` is indexed by key */
+static inline int
+get_meterframe(
+		const balanceURIs* uris, const LV2_Atom* atom,
+		uint32_t *seq, uint32_t *mask, float *val)
+{
+	if (atom->type != uris->atom_Vector) {
+		return -1;
+	}
+	const LV2_Atom_Vector* vec = (const LV2_Atom_Vector*)atom;
+	if (vec->body.child_type != uris->atom_Float || vec->body.child_size != sizeof(float)) {
+		return -1;
+	}
+	const uint32_t n = (atom->size - sizeof(LV2_Atom_Vector_Body)) / sizeof(float);
+	const float* frame = (const float*)(vec + 1);
+	if (n < MTR_FRAME_HEAD || frame[0] != MTR_FRAME_VERSION) {
+		return -1;
+	}
+	*seq  = frame[1];
+	*mask = (uint32_t)frame[2] | ((uint32_t)frame[3] << 16);
+
+	uint32_t i = MTR_FRAME_HEAD;
+	for (int k = 0; k < MTR_FRAME_KEYS; ++k) {
+		if (!(*mask & (1u << k))) {
+			continue;
+		}
+		if (i >= n) {
+			fprintf(stderr, "BLClv2: Truncated meter frame.\n");
+			return -1;
+		}
+		val[k] = frame[i++];
+	}
+	return 0;
+}
+
+static inline LV2_Atom *
+forge_bandsframe(LV2_Atom_Forge* forge,
+		const balanceURIs* uris, const int64_t time,
+		const uint32_t bpo, const int first, const uint32_t n, const float* const val)
+{
+	float frame[BANDS_FRAME_HEAD + BANDS_FRAME_MAX];
+	frame[0] = BANDS_FRAME_ID;
+	frame[1] = bpo;
+	frame[2] = first;
+	frame[3] = n;
+	memcpy(&frame[BANDS_FRAME_HEAD], val, n * sizeof(float));
+	lv2_atom_forge_frame_time(forge, time);
+	return (LV2_Atom*)lv2_atom_forge_vector(forge, sizeof(float), uris->atom_Float, BANDS_FRAME_HEAD + n, frame);
+}
+
+/* unpack a band correlation frame, `val` holds BANDS_FRAME_MAX values */
+static inline int
+get_bandsframe(
+		const balanceURIs* uris, const LV2_Atom* atom,
+		uint32_t *bpo, int *first, uint32_t *n, float *val)
+{
+	if (atom->type != uris->atom_Vector) {
+		return -1;
+	}
+	const LV2_Atom_Vector* vec = (const LV2_Atom_Vector*)atom;
+	if (vec->body.child_type != uris->atom_Float || vec->body.child_size != sizeof(float)) {
+		return -1;
+	}
+	const uint32_t len = (atom->size - sizeof(LV2_Atom_Vector_Body)) / sizeof(float);
+	const float* frame = (const float*)(vec + 1);
+	if (len < BANDS_FRAME_HEAD || frame[0] != BANDS_FRAME_ID) {
+		return -1;
+	}
+	*bpo   = frame[1];
+	*first = frame[2];
+	*n     = frame[3];
+	if (*n > BANDS_FRAME_MAX || len < BANDS_FRAME_HEAD + *n) {
+		fprintf(stderr, "BLClv2: Truncated band frame.\n");
+		return -1;
+	}
+	memcpy(val, &frame[BANDS_FRAME_HEAD], *n * sizeof(float));
+	return 0;
+}
+
+static inline LV2_Atom *
+forge_scopeframe(LV2_Atom_Forge* forge,
+		const balanceURIs* uris, const int64_t time,
+		const int mode, const uint32_t stride, const float* const pts)
+{
+	float frame[SCOPE_FRAME_HEAD + 2 * SCOPE_POINTS];
+	frame[0] = SCOPE_FRAME_ID;
+	frame[1] = mode;
+	frame[2] = SCOPE_POINTS;
+	frame[3] = stride;
+	memcpy(&frame[SCOPE_FRAME_HEAD], pts, 2 * SCOPE_POINTS * sizeof(float));
+	lv2_atom_forge_frame_time(forge, time);
+	return (LV2_Atom*)lv2_atom_forge_vector(forge, sizeof(float), uris->atom_Float, SCOPE_FRAME_HEAD + 2 * SCOPE_POINTS, frame);
+}
+
+/* unpack a vectorscope frame, `pts` holds 2 * SCOPE_POINTS values */
+static inline int
+get_scopeframe(
+		const balanceURIs* uris, const LV2_Atom* atom,
+		int *mode, uint32_t *stride, float *pts)
+{
+	if (atom->type != uris->atom_Vector) {
+		return -1;
+	}
+	const LV2_Atom_Vector* vec = (const LV2_Atom_Vector*)atom;
+	if (vec->body.child_type != uris->atom_Float || vec->body.child_size != sizeof(float)) {
+		return -1;
+	}
+	const uint32_t len = (atom->size - sizeof(LV2_Atom_Vector_Body)) / sizeof(float);
+	const float* frame = (const float*)(vec + 1);
+	if (len < SCOPE_FRAME_HEAD || frame[0] != SCOPE_FRAME_ID) {
+		return -1;
+	}
+	if (frame[2] != SCOPE_POINTS || len != SCOPE_FRAME_HEAD + 2 * SCOPE_POINTS) {
+		fprintf(stderr, "BLClv2: Invalid scope frame.\n");
+		return -1;
+	}
+	*mode   = frame[1];
+	*stride = frame[3];
+	memcpy(pts, &frame[SCOPE_FRAME_HEAD], 2 * SCOPE_POINTS * sizeof(float));
+	return 0;
+}
+
 #endif